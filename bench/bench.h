@@ -0,0 +1,244 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+/** Minimal benchmark harness shared by the quickjs++ benchmark executables.
+ *  A suite benchmark is a function running its operation a given number of times. The harness grows the iteration
+ *  count until a batch takes at least --min-time, then runs --repetitions batches and reports the fastest and
+ *  the median time per operation. The fastest batch is the most stable number to compare between builds.
+ *  A workload_suite workload is a function running one operation, e.g. one request. Operations are run for
+ *  --duration and each is timed, to report throughput, latency percentiles and peak RSS.
+ *  Usage: <executable> [--min-time=<ms>] [--repetitions=<n>] [--duration=<ms>] [--csv] [filter...]
+ *  Only benchmarks whose name contains one of the filters are run.
+ */
+namespace bench
+{
+    using clock = std::chrono::steady_clock;
+
+    /** Keeps the compiler from optimizing away a computed value. */
+    template<typename T>
+    inline void do_not_optimize(const T& val)
+    {
+    #if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(val) : "memory");
+    #else
+        static volatile const void* sink;
+        sink = &val;
+    #endif
+    }
+
+    struct options
+    {
+        std::chrono::milliseconds min_time { 50 };
+        int repetitions = 5;
+        std::chrono::milliseconds duration { 2000 };
+        bool csv = false;
+        std::vector<std::string> filters;
+
+        static options parse(int argc, char** argv)
+        {
+            options result;
+            for (int i = 1; i < argc; ++i)
+            {
+                std::string_view arg = argv[i];
+                if (arg.starts_with("--min-time="))
+                    result.min_time = std::chrono::milliseconds(std::atoi(argv[i] + 11));
+                else if (arg.starts_with("--repetitions="))
+                    result.repetitions = std::max(1, std::atoi(argv[i] + 14));
+                else if (arg.starts_with("--duration="))
+                    result.duration = std::chrono::milliseconds(std::atoi(argv[i] + 11));
+                else if (arg == "--csv")
+                    result.csv = true;
+                else
+                    result.filters.emplace_back(arg);
+            }
+            return result;
+        }
+
+        bool selected(std::string_view name) const
+        {
+            return filters.empty() || std::ranges::any_of(filters, [&](const std::string& f) {
+                return name.find(f) != std::string_view::npos;
+            });
+        }
+    };
+
+    /** A named set of benchmarks, run in the order they were added. */
+    class suite
+    {
+    public:
+        using function = std::function<void(uint64_t iterations)>;
+
+        void add(std::string name, function f)
+        {
+            m_benchmarks.push_back({ std::move(name), std::move(f) });
+        }
+
+        int run(int argc, char** argv) const
+        {
+            options opts = options::parse(argc, argv);
+            if (opts.csv)
+                std::printf("name,iterations,min_ns,median_ns\n");
+            else
+                std::printf("%-44s %12s %12s %12s\n", "benchmark", "iterations", "min ns/op", "median ns/op");
+
+            for (const auto& [name, f] : m_benchmarks)
+            {
+                if (!opts.selected(name))
+                    continue;
+
+                uint64_t iterations = calibrate(f, opts.min_time);
+                std::vector<double> ns_per_op;
+                for (int i = 0; i < opts.repetitions; ++i)
+                    ns_per_op.push_back(std::chrono::duration<double, std::nano>(time(f, iterations)).count() / iterations);
+                std::ranges::sort(ns_per_op);
+
+                double min = ns_per_op.front(), median = ns_per_op[ns_per_op.size() / 2];
+                if (opts.csv)
+                    std::printf("%s,%llu,%.2f,%.2f\n", name.c_str(), static_cast<unsigned long long>(iterations), min, median);
+                else
+                    std::printf("%-44s %12llu %12.2f %12.2f\n", name.c_str(), static_cast<unsigned long long>(iterations), min, median);
+                std::fflush(stdout);
+            }
+            return 0;
+        }
+    private:
+        struct benchmark
+        {
+            std::string name;
+            function f;
+        };
+
+        std::vector<benchmark> m_benchmarks;
+
+        static clock::duration time(const function& f, uint64_t iterations)
+        {
+            clock::time_point start = clock::now();
+            f(iterations);
+            return clock::now() - start;
+        }
+
+        static uint64_t calibrate(const function& f, std::chrono::milliseconds min_time)
+        {
+            uint64_t iterations = 1;
+            for (;;)
+            {
+                clock::duration elapsed = time(f, iterations);
+                if (elapsed >= min_time || iterations >= (uint64_t(1) << 40))
+                    return iterations;
+
+                // aim slightly past min_time, but grow at most 10x at a time
+                double scale = elapsed.count() > 0 ? 1.2 * min_time / elapsed : 10.0;
+                iterations = std::max(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale, 10.0)));
+            }
+        }
+    };
+
+    /** Peak resident set size of the process in bytes, or 0 if unknown. */
+    inline std::size_t peak_rss()
+    {
+    #ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return counters.PeakWorkingSetSize;
+    #else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+        #ifdef __APPLE__
+            return static_cast<std::size_t>(usage.ru_maxrss);
+        #else
+            return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+        #endif
+    #endif
+    }
+
+    /** A named set of whole-workload benchmarks, run in the order they were added.
+     *  Peak RSS only grows, so it reflects the workload and all workloads run before it.
+     *  Run a single workload by filter to get its own peak.
+     */
+    class workload_suite
+    {
+    public:
+        using operation = std::function<void()>;
+
+        /** @param make Sets up the workload and returns its operation. Called right before the workload runs,
+         *  so setup cost is part of peak RSS but not of the timings.
+         */
+        void add(std::string name, std::function<operation()> make)
+        {
+            m_workloads.push_back({ std::move(name), std::move(make) });
+        }
+
+        int run(int argc, char** argv) const
+        {
+            options opts = options::parse(argc, argv);
+            if (opts.csv)
+                std::printf("name,ops,ops_per_s,p50_us,p99_us,peak_rss_mb\n");
+            else
+                std::printf("%-32s %10s %12s %10s %10s %14s\n", "workload", "ops", "ops/s", "p50 us", "p99 us", "peak RSS MB");
+
+            for (const auto& [name, make] : m_workloads)
+            {
+                if (!opts.selected(name))
+                    continue;
+
+                operation op = make();
+                for (int i = 0; i < 10; ++i) // warm up
+                    op();
+
+                std::vector<double> latencies_us;
+                clock::time_point start = clock::now(), end = start;
+                while (end - start < opts.duration)
+                {
+                    op();
+                    clock::time_point now = clock::now();
+                    latencies_us.push_back(std::chrono::duration<double, std::micro>(now - end).count());
+                    end = now;
+                }
+
+                double seconds = std::chrono::duration<double>(end - start).count();
+                double throughput = latencies_us.size() / seconds;
+                double p50 = percentile(latencies_us, 0.50), p99 = percentile(latencies_us, 0.99);
+                double rss_mb = peak_rss() / (1024.0 * 1024.0);
+                if (opts.csv)
+                    std::printf("%s,%zu,%.1f,%.2f,%.2f,%.1f\n", name.c_str(), latencies_us.size(), throughput, p50, p99, rss_mb);
+                else
+                    std::printf("%-32s %10zu %12.1f %10.2f %10.2f %14.1f\n", name.c_str(), latencies_us.size(), throughput, p50, p99, rss_mb);
+                std::fflush(stdout);
+            }
+            return 0;
+        }
+    private:
+        struct workload
+        {
+            std::string name;
+            std::function<operation()> make;
+        };
+
+        std::vector<workload> m_workloads;
+
+        static double percentile(std::vector<double>& values, double p)
+        {
+            auto nth = values.begin() + static_cast<std::ptrdiff_t>(p * (values.size() - 1));
+            std::ranges::nth_element(values, nth);
+            return *nth;
+        }
+    };
+}
@@ -0,0 +1,235 @@
+#include "bench.h"
+#include <quickjs++.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+
+/** End-to-end benchmarks of typical embedding workloads. Each operation is one unit of work an embedder
+ *  would see, e.g. one request handled in a fresh context, so runtime/context changes can be judged on
+ *  whole-workload throughput, latency and memory.
+ */
+
+namespace
+{
+    /** A runtime and a context, destroyed in the right order along with the value a workload keeps. */
+    struct environment
+    {
+        qjs::runtime runtime;
+        qjs::context context { runtime };
+        std::optional<qjs::value> entry;
+
+        void run_jobs()
+        {
+            while (runtime.execute_pending_job()) {}
+        }
+    };
+
+    void check(bool condition, const char* what)
+    {
+        if (!condition)
+            throw std::runtime_error(what);
+    }
+
+    std::string escape_html(const std::string& text)
+    {
+        std::string result;
+        result.reserve(text.size());
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '&': result += "&amp;"; break;
+            case '<': result += "&lt;"; break;
+            case '>': result += "&gt;"; break;
+            case '"': result += "&quot;"; break;
+            default: result += c;
+            }
+        }
+        return result;
+    }
+
+    std::string format_price(double price)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "$%.2f", price);
+        return buffer;
+    }
+
+    /** One request per fresh context on a shared runtime: compile the handler, call it, read the response. */
+    bench::workload_suite::operation request_per_context()
+    {
+        static const char* handler = R"js(
+            function handle(text) {
+                const request = JSON.parse(text);
+                const user = request.headers['x-user'] || 'anonymous';
+                const items = request.body.items.filter(item => item.quantity > 0);
+                const total = items.reduce((sum, item) => sum + item.quantity * item.price, 0);
+                return JSON.stringify({ status: 200, user, count: items.length, total });
+            }
+        )js";
+        static const std::string request = R"({"method":"POST","path":"/cart","headers":{"x-user":"alice",)"
+            R"("content-type":"application/json"},"body":{"items":[{"quantity":1,"price":9.5},)"
+            R"({"quantity":0,"price":3},{"quantity":4,"price":1.25},{"quantity":2,"price":20}]}})";
+
+        auto runtime = std::make_shared<qjs::runtime>();
+        return [runtime] {
+            qjs::context context(*runtime);
+            context.eval(handler, "<handler>");
+            auto handle = context.global()["handle"].as<std::function<std::string(const std::string&)>>();
+            std::string response = handle(request);
+            check(response.starts_with("{\"status\":200"), "unexpected response");
+        };
+    }
+
+    /** Rendering an HTML table from JS, with a native call and string conversions per cell. */
+    bench::workload_suite::operation templating()
+    {
+        auto env = std::make_shared<environment>();
+        qjs::value global = env->context.global();
+        global["escape_html"] = escape_html;
+        global["format_price"] = format_price;
+        env->context.eval(R"js(
+            const rows = [...Array(100).keys()].map(i => ({
+                name: `Product <${i}> & "friends"`,
+                description: 'A fine product, number ' + i,
+                price: i * 1.25,
+            }));
+            function render(title) {
+                let html = `<h1>${escape_html(title)}</h1><table>`;
+                for (const row of rows)
+                    html += `<tr><td>${escape_html(row.name)}</td><td>${escape_html(row.description)}</td>` +
+                            `<td>${format_price(row.price)}</td></tr>`;
+                return html + '</table>';
+            }
+        )js", "<templating>");
+        env->entry = env->context.global()["render"];
+
+        return [env] {
+            auto render = env->entry->as<std::function<std::string(const std::string&)>>();
+            std::string html = render("Catalog <page>");
+            check(html.ends_with("</table>"), "unexpected html");
+        };
+    }
+
+    /** Parsing a JSON document, transforming it in JS and serializing the result back to C++. */
+    bench::workload_suite::operation json_round_trip()
+    {
+        std::string payload = "{\"records\":[";
+        for (int i = 0; i < 200; ++i)
+        {
+            if (i)
+                payload += ',';
+            payload += "{\"id\":" + std::to_string(i) + ",\"name\":\"record " + std::to_string(i) +
+                "\",\"active\":" + (i % 3 ? "true" : "false") + ",\"score\":" + std::to_string(i * 0.75) +
+                ",\"tags\":[\"a\",\"b\",\"c\"]}";
+        }
+        payload += "]}";
+
+        auto env = std::make_shared<environment>();
+        env->entry = env->context.eval(R"js(
+            (document) => ({
+                count: document.records.length,
+                active: document.records.filter(r => r.active).map(r => ({ id: r.id, name: r.name, score: r.score * 2 })),
+            })
+        )js", "<json>");
+
+        return [env, payload = std::move(payload)] {
+            qjs::value document = env->context.from_json(payload);
+            auto transform = env->entry->as<std::function<qjs::value(qjs::value)>>();
+            std::string json = transform(std::move(document)).to_json();
+            check(json.size() > payload.size() / 4, "unexpected json");
+        };
+    }
+
+    /** An async workflow with sequential awaits and Promise.all fan-out, driven to completion. */
+    bench::workload_suite::operation async_workflow()
+    {
+        auto env = std::make_shared<environment>();
+        env->context.global()["lookup"] = [](int key) { return key * 2; };
+        env->entry = env->context.eval(R"js(
+            (() => {
+                const load = async (key) => lookup(key);
+                return async (n) => {
+                    let total = 0;
+                    for (let i = 0; i < 20; ++i)
+                        total += await load(n + i);
+                    const parts = await Promise.all([...Array(20).keys()].map(i => load(i)));
+                    const chained = await parts.reduce((p, v) => p.then(sum => sum + v), Promise.resolve(0));
+                    return total + chained;
+                };
+            })()
+        )js", "<async>");
+
+        return [env] {
+            auto workflow = env->entry->as<std::function<qjs::value(int)>>();
+            qjs::value promise = workflow(1);
+            env->run_jobs();
+            check(JS_PromiseState(env->context.ctx, promise.v) == JS_PROMISE_FULFILLED, "workflow did not finish");
+        };
+    }
+
+    /** Startup of an application: a fresh runtime and context loading a graph of 63 modules from memory. */
+    bench::workload_suite::operation module_graph_startup()
+    {
+        // mod_i imports mod_(2i+1) and mod_(2i+2), a binary tree of depth 6
+        constexpr int module_count = 63;
+        auto sources = std::make_shared<std::map<std::string, std::string, std::less<>>>();
+        for (int i = 0; i < module_count; ++i)
+        {
+            std::string source;
+            int left = 2 * i + 1, right = 2 * i + 2;
+            if (right < module_count)
+            {
+                source += "import { value as left } from 'mod_" + std::to_string(left) + "';\n";
+                source += "import { value as right } from 'mod_" + std::to_string(right) + "';\n";
+            }
+            else
+            {
+                source += "const left = 0, right = 0;\n";
+            }
+            source += "export class Service" + std::to_string(i) + " { constructor() { this.id = " + std::to_string(i) + "; } }\n";
+            source += "export function helper(x) { return x + " + std::to_string(i) + "; }\n";
+            source += "export const value = left + right + helper(1);\n";
+            (*sources)["mod_" + std::to_string(i)] = std::move(source);
+        }
+
+        return [sources] {
+            environment env;
+            env.context.module_loader = [&sources](std::string_view name) {
+                auto it = sources->find(name);
+                if (it == sources->end())
+                    return qjs::context::module_data();
+                return qjs::context::module_data(std::string(name), it->second);
+            };
+            env.context.eval("import { value } from 'mod_0'; globalThis.result = value;", "<main>", JS_EVAL_TYPE_MODULE);
+            env.run_jobs();
+            check(env.context.global()["result"].as<int>() > 0, "modules did not load");
+        };
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::workload_suite suite;
+    suite.add("request_per_context", request_per_context);
+    suite.add("templating", templating);
+    suite.add("json_round_trip", json_round_trip);
+    suite.add("async_workflow", async_workflow);
+    suite.add("module_graph_startup", module_graph_startup);
+
+    try
+    {
+        return suite.run(argc, argv);
+    }
+    catch (const qjs::exception& ex)
+    {
+        std::cerr << ex.get_value().as<std::string>() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,286 @@
+#include "bench.h"
+#include <quickjs++.h>
+#include <iostream>
+#include <map>
+#include <optional>
+
+/** Microbenchmarks of the binding layer: native calls, conversions, property access, eval and context creation.
+ *  Calls from JS are measured by a JS loop calling the binding, so compare them with call/js_function,
+ *  which runs the same loop calling a JS function.
+ */
+
+namespace
+{
+    struct point
+    {
+        int x = 0, y = 0;
+
+        point() = default;
+        point(int x, int y) : x(x), y(y) {}
+
+        int sum() const { return x + y; }
+    };
+
+    int add(int a, int b) { return a + b; }
+
+    void noop() {}
+
+    /** Compiles `(n) => { for (let i = 0; i < n; ++i) <body>; }` and returns a function calling it. */
+    std::function<void(uint64_t)> js_loop(qjs::context& context, const std::string& setup, const std::string& body)
+    {
+        qjs::value f = context.eval("(() => { " + setup + "; return (n) => { for (let i = 0; i < n; ++i) " + body + "; }; })()");
+        auto loop = f.as<std::function<void(double)>>();
+        return [loop](uint64_t iterations) { loop(static_cast<double>(iterations)); };
+    }
+
+    /** Converts `val` to JS and frees the result, `iterations` times. */
+    template<typename T>
+    std::function<void(uint64_t)> wrap(qjs::context& context, T val)
+    {
+        return [ctx = context.ctx, val = std::move(val)](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                JSValue v = qjs::js_traits<T>::wrap(ctx, val);
+                bench::do_not_optimize(v);
+                JS_FreeValue(ctx, v);
+            }
+        };
+    }
+
+    /** Converts the result of evaluating `source` to T, `iterations` times. */
+    template<typename T>
+    std::function<void(uint64_t)> unwrap(qjs::context& context, const char* source)
+    {
+        return [val = context.eval(source)](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(val.as<T>());
+        };
+    }
+}
+
+int main(int argc, char** argv)
+{
+    qjs::runtime runtime;
+    qjs::context context(runtime);
+    bench::suite suite;
+
+    try
+    {
+        qjs::module& module = context.add_module("bench");
+        module.add("add", add);
+        module.add("noop", noop);
+        module.register_class<point>("Point")
+            .constructor<>()
+            .constructor<int, int>("PointXY")
+            .member<&point::x>("x")
+            .member<&point::sum>("sum");
+        context.eval("import * as bench from 'bench'; globalThis.bench = bench;", "<import>", JS_EVAL_TYPE_MODULE);
+
+        // native calls
+        suite.add("call/js_function", js_loop(context, "const f = (a, b) => a + b", "f(i, 1)"));
+        suite.add("call/fwrapper_noop", js_loop(context, "const f = bench.noop", "f()"));
+        suite.add("call/fwrapper_int_int", js_loop(context, "const f = bench.add", "f(i, 1)"));
+        suite.add("call/member_function", js_loop(context, "const p = new bench.PointXY(1, 2)", "p.sum()"));
+        suite.add("call/member_get", js_loop(context, "const p = new bench.PointXY(1, 2)", "p.x"));
+        suite.add("call/member_set", js_loop(context, "const p = new bench.PointXY(1, 2)", "p.x = i"));
+        suite.add("call/constructor", js_loop(context, "", "new bench.Point()"));
+        suite.add("call/constructor_int_int", js_loop(context, "", "new bench.PointXY(i, 1)"));
+
+        auto cpp_add = context.eval("(a, b) => a + b").as<std::function<int(int, int)>>();
+        suite.add("call/std_function_from_cpp", [cpp_add](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(cpp_add(static_cast<int>(i), 1));
+        });
+
+        // conversions
+        suite.add("wrap/int", wrap(context, 42));
+        suite.add("wrap/double", wrap(context, 3.5));
+        suite.add("wrap/string_16", wrap(context, std::string(16, 'a')));
+        suite.add("wrap/string_64", wrap(context, std::string(64, 'a')));
+        suite.add("wrap/string_1k", wrap(context, std::string(1024, 'a')));
+        suite.add("wrap/u16string_1k", wrap(context, std::u16string(1024, u'\u00e9')));
+        suite.add("wrap/vector_int_100", wrap(context, std::vector<int>(100, 7)));
+        suite.add("wrap/map_string_int_16", wrap(context, [] {
+            std::map<std::string, int> map;
+            for (int i = 0; i < 16; ++i)
+                map.emplace("key" + std::to_string(i), i);
+            return map;
+        }()));
+        suite.add("wrap/optional_int", wrap(context, std::optional<int>(42)));
+        suite.add("wrap/optional_empty", wrap(context, std::optional<int>()));
+        suite.add("wrap/shared_ptr", wrap(context, std::make_shared<point>(1, 2)));
+
+        suite.add("unwrap/int", unwrap<int>(context, "42"));
+        suite.add("unwrap/double", unwrap<double>(context, "3.5"));
+        suite.add("unwrap/string_16", unwrap<std::string>(context, "'a'.repeat(16)"));
+        suite.add("unwrap/string_1k", unwrap<std::string>(context, "'a'.repeat(1024)"));
+        suite.add("unwrap/string_view_1k", unwrap<std::string_view>(context, "'a'.repeat(1024)"));
+        suite.add("unwrap/u16string_1k", unwrap<std::u16string>(context, "'\\u00e9'.repeat(1024)"));
+        suite.add("unwrap/vector_int_100", unwrap<std::vector<int>>(context, "new Array(100).fill(7)"));
+        suite.add("unwrap/map_string_int_16",
+            unwrap<std::map<std::string, int>>(context, "Object.fromEntries([...Array(16).keys()].map(i => ['key' + i, i]))"));
+        suite.add("unwrap/optional_int", unwrap<std::optional<int>>(context, "42"));
+        suite.add("unwrap/optional_empty", unwrap<std::optional<int>>(context, "undefined"));
+        suite.add("unwrap/shared_ptr", unwrap<std::shared_ptr<point>>(context, "new bench.PointXY(1, 2)"));
+
+        // property access through property_proxy
+        qjs::value object = context.eval("({ x: 1, nested: { y: 2 }, array: [1, 2, 3] })");
+        suite.add("property/get", [object](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(object["x"].as<int>());
+        });
+        suite.add("property/get_nested", [object](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(object["nested"]["y"].as<int>());
+        });
+        suite.add("property/get_index", [object](uint64_t iterations) {
+            qjs::value array = object["array"];
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(array[1].as<int>());
+        });
+        suite.add("property/set", [object](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                object["x"] = static_cast<int>(i);
+        });
+
+        // building objects property by property vs preshaped
+        suite.add("object/property_proxy_4", [&context](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                qjs::value row = context.new_object();
+                row["id"] = static_cast<int>(i);
+                row["name"] = "row";
+                row["score"] = 0.5;
+                row["active"] = true;
+                bench::do_not_optimize(row);
+            }
+        });
+        suite.add("object/builder_4", [&context](uint64_t iterations) {
+            auto rows = context.new_object_builder({ "id", "name", "score", "active" });
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(rows.make(static_cast<int>(i), "row", 0.5, true));
+        });
+        suite.add("object/builder_array_1k", [&context](uint64_t iterations) {
+            auto rows = context.new_object_builder({ "id", "name", "score", "active" });
+            std::vector<std::tuple<int, std::string, double, bool>> data;
+            for (int i = 0; i < 1000; ++i)
+                data.emplace_back(i, "row", 0.5, true);
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(rows.make_array(data));
+        });
+
+        // JSON serialization into one string vs streamed in chunks
+        qjs::value document = context.eval("({ rows: [...Array(1000).keys()].map(i => ({ id: i, name: 'row ' + i, tags: ['a', 'b'], score: i / 3 })) })");
+        suite.add("json/to_json", [document](uint64_t iterations) mutable {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(document.to_json());
+        });
+        suite.add("json/to_json_stream", [document](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                std::size_t size = 0;
+                document.to_json([&size](std::string_view chunk) { size += chunk.size(); });
+                bench::do_not_optimize(size);
+            }
+        });
+
+        // JSON decoding through JS objects vs straight into C++ types
+        using rows = std::vector<std::map<std::string, double>>;
+        std::string rows_json = context.eval("JSON.stringify([...Array(1000).keys()].map(i => ({ id: i, score: i / 3 })))").as<std::string>();
+        suite.add("json/decode_via_js", [&context, rows_json](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(context.from_json(rows_json).as<rows>());
+        });
+        suite.add("json/decode_direct", [rows_json](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(qjs::from_json<rows>(rows_json));
+        });
+
+        // text kernels at each instruction set the CPU supports
+        std::string ascii_text(64 * 1024, 'a');
+        std::string mixed_text;
+        while (mixed_text.size() < 64 * 1024)
+            mixed_text += "plain ASCII, then caf\u00e9 na\u00efve \u20ac \U0001F600 ";
+        std::u16string ascii_text16(ascii_text.begin(), ascii_text.end());
+        for (auto level : { qjs::unicode::simd_level::scalar, qjs::unicode::simd_level::sse2, qjs::unicode::simd_level::avx2 })
+        {
+            if (!qjs::unicode::is_supported(level))
+                continue;
+            auto at_level = [level](auto f) {
+                return [level, f](uint64_t iterations) {
+                    auto previous = qjs::unicode::current_simd_level();
+                    qjs::unicode::set_simd_level(level);
+                    f(iterations);
+                    qjs::unicode::set_simd_level(previous);
+                };
+            };
+
+            std::string suffix = std::string("_") + qjs::unicode::to_string(level);
+            suite.add("text/is_valid_utf8_ascii_64k" + suffix, at_level([&ascii_text](uint64_t iterations) {
+                for (uint64_t i = 0; i < iterations; ++i)
+                    bench::do_not_optimize(qjs::unicode::is_valid_utf8(ascii_text));
+            }));
+            suite.add("text/is_valid_utf8_mixed_64k" + suffix, at_level([&mixed_text](uint64_t iterations) {
+                for (uint64_t i = 0; i < iterations; ++i)
+                    bench::do_not_optimize(qjs::unicode::is_valid_utf8(mixed_text));
+            }));
+            suite.add("text/widen_64k" + suffix, at_level([&ascii_text](uint64_t iterations) {
+                std::u16string out(ascii_text.size(), u'\0');
+                for (uint64_t i = 0; i < iterations; ++i)
+                {
+                    qjs::unicode::widen(ascii_text, out.data());
+                    bench::do_not_optimize(out);
+                }
+            }));
+            suite.add("text/narrow_64k" + suffix, at_level([&ascii_text16](uint64_t iterations) {
+                std::string out(ascii_text16.size(), '\0');
+                for (uint64_t i = 0; i < iterations; ++i)
+                {
+                    qjs::unicode::narrow(ascii_text16, out.data());
+                    bench::do_not_optimize(out);
+                }
+            }));
+            suite.add("text/u16string_round_trip_1k" + suffix, at_level([ctx = context.ctx](uint64_t iterations) {
+                std::u16string text(1024, u'a');
+                for (uint64_t i = 0; i < iterations; ++i)
+                {
+                    JSValue v = qjs::js_traits<std::u16string>::wrap(ctx, text);
+                    bench::do_not_optimize(qjs::js_traits<std::u16string>::unwrap(ctx, v));
+                    JS_FreeValue(ctx, v);
+                }
+            }));
+        }
+
+        // eval from source vs evaluating precompiled bytecode
+        static const char* script = "(() => { let s = 0; for (let i = 0; i < 10; ++i) s += i; return s; })()";
+        suite.add("eval/source", [&context](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(context.eval(script));
+        });
+        qjs::value compiled = context.eval(script, "<eval>", JS_EVAL_FLAG_COMPILE_ONLY);
+        suite.add("eval/cached", [&context, compiled](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                bench::do_not_optimize(qjs::value(context.ctx, JS_EvalFunction(context.ctx, JS_DupValue(context.ctx, compiled.v))));
+        });
+
+        // context creation
+        suite.add("context/create", [&runtime](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+                qjs::context fresh(runtime);
+        });
+        suite.add("context/create_with_runtime", [](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i)
+            {
+                qjs::runtime fresh_runtime;
+                qjs::context fresh(fresh_runtime);
+            }
+        });
+
+        return suite.run(argc, argv);
+    }
+    catch (const qjs::exception& ex)
+    {
+        std::cerr << ex.get_value().as<std::string>() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
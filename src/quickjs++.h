@@ -1,2 +1,16 @@
+#include "quickjs++/allocations.h"
+#include "quickjs++/binding_template.h"
+#include "quickjs++/completion_queue.h"
 #include "quickjs++/context.h"
+#include "quickjs++/coroutine.h"
+#include "quickjs++/event_loop.h"
+#include "quickjs++/heap_snapshot.h"
+#include "quickjs++/instrumentation.h"
+#include "quickjs++/json.h"
+#include "quickjs++/message.h"
+#include "quickjs++/profiler.h"
 #include "quickjs++/runtime.h"
+#include "quickjs++/runtime_pool.h"
+#include "quickjs++/shared_buffer.h"
+#include "quickjs++/tracing.h"
+#include "quickjs++/unicode.h"
@@ -0,0 +1,226 @@
+#include "allocations.h"
+#include "instrumentation.h"
+#include "runtime.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+namespace qjs
+{
+    namespace
+    {
+        std::atomic<bool> tracking_enabled { false };
+
+        /** Precedes every allocation. Sized to keep the allocation aligned like malloc's. */
+        struct alignas(alignof(std::max_align_t)) allocation_header
+        {
+            void* owner;
+            std::size_t size;
+        };
+
+        allocation_header* header_of(const void* ptr)
+        {
+            return const_cast<allocation_header*>(static_cast<const allocation_header*>(ptr) - 1);
+        }
+
+        /** Sorts by live bytes, largest first, and keeps the first `top` entries. */
+        std::vector<allocations::consumer> top_consumers(std::vector<allocations::consumer> consumers, std::size_t top)
+        {
+            std::ranges::sort(consumers, [](const auto& a, const auto& b) { return a.bytes > b.bytes; });
+            if (top && consumers.size() > top)
+                consumers.resize(top);
+            return consumers;
+        }
+    }
+
+    namespace allocations
+    {
+        void enable(bool enabled) noexcept
+        {
+            tracking_enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        bool enabled() noexcept
+        {
+            return tracking_enabled.load(std::memory_order_relaxed);
+        }
+
+        allocation_snapshot snapshot(const runtime& rt, std::size_t top)
+        {
+            if (!rt.allocation_tracker())
+                return {};
+            return rt.allocation_tracker()->snapshot(top);
+        }
+    }
+
+    namespace detail
+    {
+        const JSMallocFunctions allocation_tracker::functions = {
+            .js_calloc = calloc,
+            .js_malloc = malloc,
+            .js_free = free,
+            .js_realloc = realloc,
+            .js_malloc_usable_size = usable_size,
+        };
+
+        void allocation_tracker::context_freed(JSContext* ctx)
+        {
+            std::lock_guard lock(m_mutex);
+            m_last = nullptr;
+            std::erase_if(m_lookup, [ctx](const auto& entry) { return entry.first.ctx == ctx; });
+            for (auto it = m_stats.begin(); it != m_stats.end();)
+            {
+                if (it->owner.ctx == ctx)
+                    it->detached = true;
+
+                // nothing points to detached statistics without live allocations anymore
+                if (it->detached && it->allocations.load(std::memory_order_relaxed) == 0)
+                    it = m_stats.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        allocations::allocation_snapshot allocation_tracker::snapshot(std::size_t top) const
+        {
+            std::map<JSContext*, allocations::consumer> contexts;
+            std::map<int, allocations::consumer> bindings;
+            allocations::allocation_snapshot result {};
+
+            {
+                std::lock_guard lock(m_mutex);
+                for (const stats& s : m_stats)
+                {
+                    auto bytes = static_cast<std::size_t>(std::max<int64_t>(s.bytes.load(std::memory_order_relaxed), 0));
+                    auto count = static_cast<std::size_t>(std::max<int64_t>(s.allocations.load(std::memory_order_relaxed), 0));
+                    uint64_t allocated = s.allocated_bytes.load(std::memory_order_relaxed);
+                    result.bytes += bytes;
+                    result.allocations += count;
+
+                    JSContext* ctx = s.detached ? nullptr : s.owner.ctx;
+                    auto& by_context = contexts.try_emplace(ctx, allocations::consumer { ctx, {}, 0, 0, 0 }).first->second;
+                    by_context.bytes += bytes;
+                    by_context.allocations += count;
+                    by_context.allocated_bytes += allocated;
+
+                    auto& by_binding = bindings.try_emplace(s.owner.binding, allocations::consumer { nullptr, {}, 0, 0, 0 }).first->second;
+                    by_binding.bytes += bytes;
+                    by_binding.allocations += count;
+                    by_binding.allocated_bytes += allocated;
+                }
+            }
+
+            for (auto& [ctx, consumer] : contexts)
+                result.contexts.push_back(std::move(consumer));
+            for (auto& [binding, consumer] : bindings)
+            {
+                consumer.binding = binding_name(binding);
+                result.bindings.push_back(std::move(consumer));
+            }
+
+            result.contexts = top_consumers(std::move(result.contexts), top);
+            result.bindings = top_consumers(std::move(result.bindings), top);
+            return result;
+        }
+
+        allocation_tracker::stats* allocation_tracker::stats_for(const allocation_tag& tag)
+        {
+            if (m_last && tag_equal()(m_last->owner, tag))
+                return m_last;
+
+            if (auto it = m_lookup.find(tag); it != m_lookup.end())
+                return m_last = it->second;
+
+            // a failed insertion makes the allocation fail, as it would without tracking
+            std::lock_guard lock(m_mutex);
+            stats& s = m_stats.emplace_back();
+            s.owner = tag;
+            m_lookup.emplace(tag, &s);
+            return m_last = &s;
+        }
+
+        void* allocation_tracker::calloc(void* opaque, std::size_t count, std::size_t size)
+        {
+            if (size && count > (SIZE_MAX - sizeof(allocation_header)) / size)
+                return nullptr;
+
+            void* ptr = malloc(opaque, count * size);
+            if (ptr)
+                std::memset(ptr, 0, count * size);
+            return ptr;
+        }
+
+        void* allocation_tracker::malloc(void* opaque, std::size_t size)
+        {
+            if (size > SIZE_MAX - sizeof(allocation_header))
+                return nullptr;
+
+            auto self = static_cast<allocation_tracker*>(opaque);
+            stats* owner;
+            try
+            {
+                owner = self->stats_for(current_allocation_tag);
+            }
+            catch (...)
+            {
+                return nullptr;
+            }
+
+            auto header = static_cast<allocation_header*>(std::malloc(sizeof(allocation_header) + size));
+            if (!header)
+                return nullptr;
+
+            *header = { owner, size };
+            owner->bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+            owner->allocations.fetch_add(1, std::memory_order_relaxed);
+            owner->allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+            return header + 1;
+        }
+
+        void allocation_tracker::free(void*, void* ptr)
+        {
+            if (!ptr)
+                return;
+
+            allocation_header* header = header_of(ptr);
+            auto owner = static_cast<stats*>(header->owner);
+            owner->bytes.fetch_sub(static_cast<int64_t>(header->size), std::memory_order_relaxed);
+            owner->allocations.fetch_sub(1, std::memory_order_relaxed);
+            std::free(header);
+        }
+
+        void* allocation_tracker::realloc(void* opaque, void* ptr, std::size_t size)
+        {
+            if (!ptr)
+                return size ? malloc(opaque, size) : nullptr;
+            if (!size)
+            {
+                free(opaque, ptr);
+                return nullptr;
+            }
+            if (size > SIZE_MAX - sizeof(allocation_header))
+                return nullptr;
+
+            // resized memory stays attributed to whoever allocated it
+            allocation_header* header = header_of(ptr);
+            std::size_t old_size = header->size;
+            auto resized = static_cast<allocation_header*>(std::realloc(header, sizeof(allocation_header) + size));
+            if (!resized)
+                return nullptr;
+
+            auto owner = static_cast<stats*>(resized->owner);
+            resized->size = size;
+            owner->bytes.fetch_add(static_cast<int64_t>(size) - static_cast<int64_t>(old_size), std::memory_order_relaxed);
+            if (size > old_size)
+                owner->allocated_bytes.fetch_add(size - old_size, std::memory_order_relaxed);
+            return resized + 1;
+        }
+
+        std::size_t allocation_tracker::usable_size(const void* ptr)
+        {
+            return ptr ? header_of(ptr)->size : 0;
+        }
+    }
+}
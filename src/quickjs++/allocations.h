@@ -0,0 +1,163 @@
+#pragma once
+#include <quickjs/quickjs.h>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace qjs
+{
+    class runtime;
+
+    /** Opt-in accounting of the heap memory of runtimes, attributed to the context and the native binding
+     *  that were active when memory was allocated. Memory stays attributed to its allocator until freed.
+     *  Only runtimes created while accounting is enabled are tracked, since the runtime's allocator is chosen at
+     *  creation. Bindings are told apart by their instrumentation ids, so qjs::instrumentation must be enabled
+     *  before bindings are created for the per-binding breakdown.
+     *  Jobs posted through context::enqueue_job or a completion_queue, and event_loop timers, count towards their
+     *  context. Promise reactions and async function resumptions run by runtime::execute_pending_job don't:
+     *  quickjs only tells which context a job belongs to after running it, so, outside of bindings, their memory
+     *  goes to the scope of the caller, which is no context when called from an event_loop. The same applies to
+     *  event_loop fd watcher callbacks, which have no context.
+     *  Example:
+     *  qjs::allocations::enable();
+     *  qjs::runtime runtime;
+     *  ...
+     *  for (const auto& consumer : qjs::allocations::snapshot(runtime, 5).contexts)
+     *      std::cout << consumer.ctx << ": " << consumer.bytes << " bytes\n";
+     */
+    namespace allocations
+    {
+        /** Live memory of one context or binding. */
+        struct consumer
+        {
+            /// Context, or nullptr for memory of the runtime itself and of contexts that were already freed.
+            JSContext* ctx;
+            /// Binding name, or empty for memory allocated outside of any tracked binding.
+            std::string binding;
+            /// Bytes allocated and not yet freed.
+            std::size_t bytes;
+            /// Allocations not yet freed.
+            std::size_t allocations;
+            /// Bytes allocated over the whole lifetime, including freed ones.
+            uint64_t allocated_bytes;
+        };
+
+        struct allocation_snapshot
+        {
+            std::size_t bytes;
+            std::size_t allocations;
+            /// Live memory by context, largest first. binding is empty.
+            std::vector<consumer> contexts;
+            /// Live memory by binding across contexts, largest first. ctx is nullptr.
+            std::vector<consumer> bindings;
+        };
+
+        void enable(bool enabled = true) noexcept;
+        bool enabled() noexcept;
+
+        /** Current memory use of a runtime, or an empty snapshot if it isn't tracked.
+         *  Can be called from any thread.
+         *  @param top Maximum number of contexts and bindings listed, 0 for all.
+         */
+        allocation_snapshot snapshot(const runtime& rt, std::size_t top = 0);
+    }
+
+    namespace detail
+    {
+        /** Owner that new allocations on this thread are attributed to. */
+        struct allocation_tag
+        {
+            JSContext* ctx = nullptr;
+            int binding = 0;
+        };
+
+        constinit inline thread_local allocation_tag current_allocation_tag {};
+
+        /** Attributes allocations on this thread to a context, and optionally a binding, for its lifetime.
+         *  Costs two thread-local stores whether or not accounting is enabled.
+         */
+        class allocation_scope
+        {
+        public:
+            /** Keeps the current binding when nested in a call of a binding of the same context. */
+            explicit allocation_scope(JSContext* ctx) noexcept : m_previous(current_allocation_tag)
+            {
+                current_allocation_tag = { ctx, m_previous.ctx == ctx ? m_previous.binding : 0 };
+            }
+
+            allocation_scope(JSContext* ctx, int binding) noexcept : m_previous(current_allocation_tag)
+            {
+                current_allocation_tag = { ctx, binding };
+            }
+
+            allocation_scope(const allocation_scope&) = delete;
+
+            ~allocation_scope()
+            {
+                current_allocation_tag = m_previous;
+            }
+        private:
+            allocation_tag m_previous;
+        };
+
+        /** Allocator of a tracked runtime. Each allocation is prefixed by a header pointing to the statistics
+         *  of its owner, so frees need no lookup. Statistics are only created and removed on the runtime's thread,
+         *  under a mutex that snapshots also take.
+         */
+        class allocation_tracker
+        {
+        public:
+            static const JSMallocFunctions functions;
+
+            allocation_tracker() = default;
+            allocation_tracker(const allocation_tracker&) = delete;
+
+            /** Stops attributing new allocations to ctx, whose address may be reused by a new context. */
+            void context_freed(JSContext* ctx);
+
+            allocations::allocation_snapshot snapshot(std::size_t top) const;
+        private:
+            struct stats
+            {
+                allocation_tag owner;
+                bool detached = false;
+                std::atomic<int64_t> bytes { 0 };
+                std::atomic<int64_t> allocations { 0 };
+                std::atomic<uint64_t> allocated_bytes { 0 };
+            };
+
+            struct tag_hash
+            {
+                std::size_t operator()(const allocation_tag& tag) const noexcept
+                {
+                    return std::hash<JSContext*>()(tag.ctx) ^ (static_cast<std::size_t>(tag.binding) * 0x9e3779b97f4a7c15ull);
+                }
+            };
+
+            struct tag_equal
+            {
+                bool operator()(const allocation_tag& a, const allocation_tag& b) const noexcept
+                {
+                    return a.ctx == b.ctx && a.binding == b.binding;
+                }
+            };
+
+            mutable std::mutex m_mutex;
+            std::list<stats> m_stats;
+            std::unordered_map<allocation_tag, stats*, tag_hash, tag_equal> m_lookup;
+            stats* m_last = nullptr;
+
+            stats* stats_for(const allocation_tag& tag);
+
+            static void* calloc(void* opaque, std::size_t count, std::size_t size);
+            static void* malloc(void* opaque, std::size_t size);
+            static void free(void* opaque, void* ptr);
+            static void* realloc(void* opaque, void* ptr, std::size_t size);
+            static std::size_t usable_size(const void* ptr);
+        };
+    }
+}
@@ -0,0 +1,26 @@
+#include "binding_template.h"
+
+namespace qjs
+{
+    module& module_template::instantiate(context& context) const
+    {
+        module& module = context.add_module(m_name);
+        for (const auto& define : m_definitions)
+            define(module);
+        return module;
+    }
+
+    module_template& binding_template::add_module(const char* name)
+    {
+        auto tmpl = std::make_shared<module_template>(name);
+        m_definitions.emplace_back([tmpl](context& context) { tmpl->instantiate(context); });
+        return *tmpl;
+    }
+
+    void binding_template::instantiate(context& context) const
+    {
+        // replayed in order, e.g. so that a class registered after a module can use the module's classes as bases
+        for (const auto& define : m_definitions)
+            define(context);
+    }
+}
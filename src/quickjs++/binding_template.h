@@ -0,0 +1,196 @@
+#pragma once
+#include "context.h"
+#include <algorithm>
+
+namespace qjs
+{
+    /** Records the calls made on a class_registrar so they can be replayed into any number of contexts.
+     *  Has the same interface as class_registrar. See binding_template.
+     */
+    template<typename T> requires std::is_class_v<T>
+    class class_template
+    {
+    public:
+        class_template(const char* name, bool lazy) : m_name(name), m_lazy(lazy) {}
+        class_template(const class_template&) = delete;
+
+        template<typename B>
+            requires (std::is_class_v<B> && !std::same_as<B, T>)
+        class_template& base()
+        {
+            return record([](class_registrar<T>& r) { r.template base<B>(); });
+        }
+
+        template<typename... Args> requires std::constructible_from<T, Args...>
+        class_template& constructor(const char* name = nullptr)
+        {
+            return record([name](class_registrar<T>& r) { r.template constructor<Args...>(name); });
+        }
+
+        template<typename... Signatures>
+            requires (sizeof...(Signatures) > 0 && (detail::is_constructor_signature<Signatures, T>::value && ...))
+        class_template& constructors(const char* name = nullptr)
+        {
+            return record([name](class_registrar<T>& r) { r.template constructors<Signatures...>(name); });
+        }
+
+        template<typename F>
+            requires (std::is_function_v<std::remove_pointer_t<F>> ||
+                      requires { &std::remove_reference_t<F>::operator(); })
+        class_template& function(F&& f, const char* name)
+        {
+            return record([f = std::forward<F>(f), name](class_registrar<T>& r) { r.function(f, name); });
+        }
+
+        /** Applied once, when recorded, rather than on every instantiate.
+         *  The marked members are shared by all runtimes, so replaying them would add duplicates that get marked
+         *  twice, and would modify them while other runtimes' garbage collectors read them.
+         */
+        template <value T::* V>
+        class_template& mark()
+        {
+            auto& offsets = js_traits<std::shared_ptr<T>>::mark_offsets;
+            if (std::ranges::find(offsets, V) == offsets.end())
+                offsets.push_back(V);
+            return *this;
+        }
+
+        template<auto M, auto... Ms> requires std::is_member_pointer_v<decltype(M)>
+        class_template& member(const char* name)
+        {
+            return record([name](class_registrar<T>& r) { r.template member<M, Ms...>(name); });
+        }
+
+        template<auto FGet, auto FSet = nullptr>
+        class_template& property(const char* name)
+        {
+            return record([name](class_registrar<T>& r) { r.template property<FGet, FSet>(name); });
+        }
+
+        template<auto M> requires detail::maybe_static_member_v<decltype(M)>
+        class_template& static_member(const char* name)
+        {
+            return record([name](class_registrar<T>& r) { r.template static_member<M>(name); });
+        }
+
+        class_template& exotic(JSClassExoticMethods* methods)
+        {
+            return record([methods](class_registrar<T>& r) { r.exotic(methods); });
+        }
+
+        class_template& indexed() requires detail::indexed_container<T>
+        {
+            return record([](class_registrar<T>& r) { r.indexed(); });
+        }
+
+        class_template& keyed() requires detail::keyed_container<T>
+        {
+            return record([](class_registrar<T>& r) { r.keyed(); });
+        }
+
+        /** Register the class in a context. */
+        void instantiate(context& context) const
+        {
+            class_registrar<T> registrar(m_name, context, nullptr, m_lazy);
+            replay(registrar);
+        }
+
+        /** Register the class in the context of a module and export its constructors from it. */
+        void instantiate(module& module) const
+        {
+            class_registrar<T> registrar = module.register_class<T>(m_name, m_lazy);
+            replay(registrar);
+        }
+    private:
+        const char* m_name;
+        bool m_lazy;
+        std::vector<std::function<void(class_registrar<T>&)>> m_steps;
+
+        void replay(class_registrar<T>& registrar) const
+        {
+            for (const auto& step : m_steps)
+                step(registrar);
+        }
+
+        template<typename F>
+        class_template& record(F&& step)
+        {
+            m_steps.emplace_back(std::forward<F>(step));
+            return *this;
+        }
+    };
+
+    /** Records the exports of a module so they can be replayed into any number of contexts. See binding_template. */
+    class module_template
+    {
+    public:
+        explicit module_template(const char* name) : m_name(name) {}
+        module_template(const module_template&) = delete;
+
+        /** Add an export. Values are stored and converted again for every context. */
+        template<typename T> requires (has_js_traits<std::decay_t<T>> || detail::any_invocable<T>)
+        module_template& add(const char* name, T&& value)
+        {
+            m_definitions.emplace_back([name, value = std::forward<T>(value)](module& m) {
+                m.add(name, std::decay_t<T>(value));
+            });
+            return *this;
+        }
+
+        /** Register class T and export its constructors from this module.
+         *  @param lazy Defer creating the prototype members until the class is first used. Defaults to true.
+         */
+        template<typename T> requires std::is_class_v<T>
+        class_template<T>& register_class(const char* name, bool lazy = true)
+        {
+            auto tmpl = std::make_shared<class_template<T>>(name, lazy);
+            m_definitions.emplace_back([tmpl](module& m) { tmpl->instantiate(m); });
+            return *tmpl;
+        }
+
+        /** Create this module in a context and define all recorded exports. */
+        module& instantiate(context& context) const;
+    private:
+        const char* m_name;
+        std::vector<std::function<void(module&)>> m_definitions;
+    };
+
+    /** Process-wide record of class and module bindings.
+     *  Bindings are described once, then created in each context with a single call to instantiate,
+     *  instead of re-running the same class_registrar chains and module::add calls per context.
+     *  Classes are lazy by default, so instantiation cost grows with the number of classes rather than members.
+     *  Example:
+     *  static qjs::binding_template bindings = [] {
+     *      qjs::binding_template t;
+     *      t.add_module("MyModule").register_class<T>("T").constructor<>().member<&T::func>("func");
+     *      return t;
+     *  }();
+     *  bindings.instantiate(context);
+     */
+    class binding_template
+    {
+    public:
+        binding_template() = default;
+        binding_template(binding_template&&) = default;
+        binding_template(const binding_template&) = delete;
+
+        /** Create module template and return a reference to it. */
+        module_template& add_module(const char* name);
+
+        /** Register class T without exporting it from any module.
+         *  @param lazy Defer creating the prototype members until the class is first used. Defaults to true.
+         */
+        template<typename T> requires std::is_class_v<T>
+        class_template<T>& register_class(const char* name, bool lazy = true)
+        {
+            auto tmpl = std::make_shared<class_template<T>>(name, lazy);
+            m_definitions.emplace_back([tmpl](context& context) { tmpl->instantiate(context); });
+            return *tmpl;
+        }
+
+        /** Create all recorded classes and modules in a context, in the order they were added. */
+        void instantiate(context& context) const;
+    private:
+        std::vector<std::function<void(context&)>> m_definitions;
+    };
+}
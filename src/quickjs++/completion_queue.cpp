@@ -0,0 +1,243 @@
+#include "completion_queue.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace qjs
+{
+    completion_queue::completion_queue() : m_head(&m_stub), m_tail(&m_stub)
+    {
+        #ifdef __linux__
+        m_fd[0] = m_fd[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (m_fd[0] < 0)
+            throw std::runtime_error("Cannot create eventfd");
+        #elif !defined(_WIN32)
+        if (pipe(m_fd) < 0)
+            throw std::runtime_error("Cannot create pipe");
+        for (int fd : m_fd)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        #endif
+    }
+
+    completion_queue::~completion_queue()
+    {
+        stop_waiter();
+
+        // jobs posted after close() are still queued; they hold no JS values, so they can be freed on any thread
+        while (node* n = pop())
+            delete n;
+
+        #ifndef _WIN32
+        if (m_fd[0] >= 0)
+            ::close(m_fd[0]);
+        if (m_fd[1] >= 0 && m_fd[1] != m_fd[0])
+            ::close(m_fd[1]);
+        #endif
+    }
+
+    bool completion_queue::post(JSContext* ctx, std::function<void()> job)
+    {
+        if (m_closed.load(std::memory_order_acquire))
+            return false;
+
+        node* n = new node;
+        n->ctx = ctx;
+        n->job = std::move(job);
+        push(n);
+        signal();
+        return true;
+    }
+
+    bool completion_queue::post_when(JSContext* ctx, std::function<bool()> is_ready, std::function<void()> job)
+    {
+        std::lock_guard lock(m_wait_mutex);
+        if (m_waiter_stopping || m_closed.load(std::memory_order_acquire))
+            return false;
+
+        m_waits.push_back({ ctx, std::move(is_ready), std::move(job) });
+        m_waits_added = true;
+        if (!m_waiter.joinable())
+            m_waiter = std::thread(&completion_queue::run_waiter, this);
+        m_wait_cv.notify_one();
+        return true;
+    }
+
+    void completion_queue::run_waiter()
+    {
+        constexpr auto min_delay = std::chrono::microseconds(100);
+        constexpr auto max_delay = std::chrono::milliseconds(5);
+        std::chrono::microseconds delay = min_delay;
+
+        std::unique_lock lock(m_wait_mutex);
+        while (!m_waiter_stopping)
+        {
+            if (m_waits.empty())
+            {
+                m_wait_cv.wait(lock, [this] { return m_waiter_stopping || !m_waits.empty(); });
+                delay = min_delay;
+                continue;
+            }
+
+            // checked without the lock, so posting more waits doesn't wait for a round
+            std::vector<pending_wait> waits = std::exchange(m_waits, {});
+            m_waits_added = false;
+            lock.unlock();
+
+            bool progress = false;
+            std::erase_if(waits, [&](pending_wait& w) {
+                if (!w.is_ready())
+                    return false;
+                post(w.ctx, std::move(w.job));
+                progress = true;
+                return true;
+            });
+
+            lock.lock();
+            m_waits.insert(m_waits.end(), std::make_move_iterator(waits.begin()), std::make_move_iterator(waits.end()));
+            delay = progress ? min_delay : std::min<std::chrono::microseconds>(delay * 2, max_delay);
+            m_wait_cv.wait_for(lock, delay, [this] { return m_waiter_stopping || m_waits_added; });
+        }
+    }
+
+    void completion_queue::stop_waiter() noexcept
+    {
+        {
+            std::lock_guard lock(m_wait_mutex);
+            m_waiter_stopping = true;
+        }
+        m_wait_cv.notify_all();
+        if (m_waiter.joinable())
+            m_waiter.join();
+        m_waits.clear();
+    }
+
+    std::size_t completion_queue::drain()
+    {
+        // clear the signal first so a post racing with the drain below always signals again
+        unsignal();
+
+        std::size_t count = 0;
+        while (node* n = pop())
+        {
+            std::unique_ptr<node> owned(n);
+            JSValue job = js_traits<fwrapper<std::function<void()>>>::wrap(n->ctx, { std::move(n->job), "job" });
+            if (JS_IsException(job))
+                throw exception(n->ctx);
+
+            int err = JS_EnqueueJob(n->ctx, [](JSContext* ctx, int argc, JSValueConst* argv) {
+                return JS_Call(ctx, argv[0], JS_UNDEFINED, 0, nullptr);
+            }, 1, &job);
+            JS_FreeValue(n->ctx, job);
+            if (err < 0)
+                throw exception(n->ctx);
+            ++count;
+        }
+
+        return count;
+    }
+
+    void completion_queue::close()
+    {
+        m_closed.store(true, std::memory_order_release);
+        stop_waiter();
+        while (node* n = pop())
+            delete n;
+        m_held.clear();
+    }
+
+    uint64_t completion_queue::hold(value first, value second)
+    {
+        uint64_t id = m_next_id++;
+        m_held.emplace(id, std::pair(std::move(first), std::move(second)));
+        return id;
+    }
+
+    std::pair<value, value> completion_queue::release(uint64_t id)
+    {
+        auto it = m_held.find(id);
+        if (it == m_held.end())
+            throw std::out_of_range("No values held for completion id");
+
+        std::pair<value, value> result = std::move(it->second);
+        m_held.erase(it);
+        return result;
+    }
+
+    void completion_queue::push(node* n) noexcept
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node* prev = m_head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    completion_queue::node* completion_queue::pop() noexcept
+    {
+        node* tail = m_tail;
+        node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &m_stub)
+        {
+            if (!next)
+                return nullptr;
+            m_tail = tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next)
+        {
+            m_tail = next;
+            return tail;
+        }
+
+        // tail is the last node unless a producer is between its exchange and its link; it signals again after linking
+        if (tail != m_head.load(std::memory_order_acquire))
+            return nullptr;
+
+        push(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next)
+        {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    void completion_queue::signal() noexcept
+    {
+        if (m_signaled.exchange(true))
+            return;
+
+        #ifndef _WIN32
+        if (m_fd[1] >= 0)
+        {
+            #ifdef __linux__
+            uint64_t one = 1;
+            [[maybe_unused]] auto written = write(m_fd[1], &one, sizeof(one));
+            #else
+            char one = 1;
+            [[maybe_unused]] auto written = write(m_fd[1], &one, sizeof(one));
+            #endif
+        }
+        #endif
+    }
+
+    void completion_queue::unsignal() noexcept
+    {
+        m_signaled.store(false);
+
+        #ifndef _WIN32
+        char buffer[64];
+        if (m_fd[0] >= 0)
+            while (read(m_fd[0], buffer, sizeof(buffer)) > 0) {}
+        #endif
+    }
+}
@@ -0,0 +1,194 @@
+#pragma once
+#include "context.h"
+#include "runtime.h"
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace qjs
+{
+    /** Thread-safe handoff of jobs from worker threads back to the thread that owns a runtime.
+     *  Any thread may post; only the owning thread may drain, which moves the posted jobs into
+     *  the job queues of their contexts (see context::enqueue_job) to be run by runtime::execute_pending_job.
+     *  Posting is lock-free (an intrusive MPSC queue) and signals a file descriptor that a host loop can poll.
+     *  Every qjs::runtime owns one, see runtime::completions.
+     *  Posted jobs are destroyed on whichever thread drops them, so they must not hold JS values;
+     *  keep those on the owning thread with hold/release and post their id instead.
+     */
+    class completion_queue
+    {
+    public:
+        completion_queue();
+        completion_queue(const completion_queue&) = delete;
+        ~completion_queue();
+
+        /** Post a job to run in `ctx` on the owning thread. Thread-safe.
+         *  `ctx` must still be alive when the queue is drained.
+         *  @return false if the runtime is gone and the job was dropped.
+         */
+        bool post(JSContext* ctx, std::function<void()> job);
+
+        /** Post `job` once `is_ready` returns true. Thread-safe.
+         *  For results without a continuation hook, like std::future. One waiter thread per queue, started on
+         *  first use, polls all pending `is_ready` in turn, sleeping between rounds with a backoff of up to 5 ms,
+         *  so a result can take that long to be noticed. `is_ready` must not block.
+         *  The waiter stops when the queue is closed, dropping the jobs still waiting.
+         *  @return false if the queue is closed and the job was dropped.
+         */
+        bool post_when(JSContext* ctx, std::function<bool()> is_ready, std::function<void()> job);
+
+        /** File descriptor that becomes readable when jobs are posted, or -1 if the platform has none.
+         *  Stays valid until the queue is destroyed.
+         */
+        int fd() const noexcept { return m_fd[0]; }
+
+        /** Move all posted jobs into their contexts' job queues and reset fd. Owning thread only.
+         *  @return Number of jobs moved.
+         */
+        std::size_t drain();
+
+        /** Drop pending jobs and held values, stop the waiter thread and refuse further posts. Owning thread only.
+         *  Called by ~runtime before the JS runtime is freed.
+         */
+        void close();
+
+        /** Keep a pair of JS values alive on the owning thread and return an id for them. Owning thread only.
+         *  Used to pass promise resolving functions through worker threads without those threads owning them.
+         */
+        uint64_t hold(value first, value second);
+
+        /** Take back the values stored by hold. Owning thread only. */
+        std::pair<value, value> release(uint64_t id);
+
+        /** Number of values currently held, i.e. results still expected from other threads. Owning thread only. */
+        std::size_t held() const noexcept { return m_held.size(); }
+    private:
+        struct node
+        {
+            std::atomic<node*> next { nullptr };
+            JSContext* ctx = nullptr;
+            std::function<void()> job;
+        };
+
+        std::atomic<node*> m_head;
+        node* m_tail;
+        node m_stub;
+        std::atomic<bool> m_signaled { false };
+        std::atomic<bool> m_closed { false };
+        int m_fd[2] { -1, -1 };
+
+        uint64_t m_next_id = 0;
+        std::unordered_map<uint64_t, std::pair<value, value>> m_held;
+
+        struct pending_wait
+        {
+            JSContext* ctx;
+            std::function<bool()> is_ready;
+            std::function<void()> job;
+        };
+
+        std::mutex m_wait_mutex;
+        std::condition_variable m_wait_cv;
+        std::vector<pending_wait> m_waits;
+        bool m_waits_added = false;
+        bool m_waiter_stopping = false;
+        std::thread m_waiter;
+
+        void run_waiter();
+        void stop_waiter() noexcept;
+        void push(node* n) noexcept;
+        node* pop() noexcept;
+        void signal() noexcept;
+        void unsignal() noexcept;
+    };
+
+    /** Conversion traits from std::future<T> to a JS promise.
+     *  std::future has no continuation hook, so the runtime's completion_queue polls it from its waiter thread
+     *  (see completion_queue::post_when) and posts the settlement. The promise settles after the next drain.
+     *  Work that already runs on a thread pool should post to runtime::completions directly instead,
+     *  which settles without the polling delay. Wrapping throws an InternalError once the queue is closed.
+     */
+    template<typename T>
+    struct js_traits<std::future<T>>
+    {
+        static std::future<T> unwrap(JSContext* ctx, JSValueConst val)
+        {
+            JS_ThrowTypeError(ctx, "Can't unwrap std::future");
+            throw exception(ctx);
+        }
+
+        static JSValue wrap(JSContext* ctx, std::future<T> val) noexcept
+        {
+            runtime* rt = runtime::get(JS_GetRuntime(ctx));
+            if (!rt)
+                return JS_ThrowInternalError(ctx, "std::future requires a runtime created by qjs::runtime");
+
+            JSValue resolving_funcs[2];
+            JSValue promise = JS_NewPromiseCapability(ctx, resolving_funcs);
+            if (JS_IsException(promise))
+                return promise;
+
+            try
+            {
+                std::shared_ptr<completion_queue> queue = rt->completions();
+                uint64_t id = queue->hold(value(ctx, std::move(resolving_funcs[0])), value(ctx, std::move(resolving_funcs[1])));
+
+                std::shared_future<T> result(std::move(val));
+                auto is_ready = [result] { return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; };
+                bool posted = queue->post_when(ctx, std::move(is_ready), [q = queue.get(), ctx, id, result] {
+                    auto [resolve, reject] = q->release(id);
+                    JSValue outcome = JS_UNDEFINED;
+                    bool rejected = false;
+                    try
+                    {
+                        if constexpr (std::is_void_v<T>)
+                            result.get();
+                        else
+                            outcome = js_traits<std::decay_t<T>>::wrap(ctx, result.get());
+                        if (JS_IsException(outcome))
+                            throw exception(ctx);
+                    }
+                    catch (const exception&)
+                    {
+                        rejected = true;
+                    }
+                    catch (const std::exception& ex)
+                    {
+                        JS_ThrowInternalError(ctx, "%s", ex.what());
+                        rejected = true;
+                    }
+                    catch (...)
+                    {
+                        JS_ThrowInternalError(ctx, "Unknown error");
+                        rejected = true;
+                    }
+
+                    if (rejected)
+                        outcome = JS_GetException(ctx);
+                    JSValue ret = JS_Call(ctx, rejected ? reject.v : resolve.v, JS_UNDEFINED, 1, &outcome);
+                    JS_FreeValue(ctx, outcome);
+                    JS_FreeValue(ctx, ret);
+                });
+
+                // a closed queue would never settle the promise, and the held id would keep the event loop alive
+                if (!posted)
+                {
+                    queue->release(id);
+                    JS_FreeValue(ctx, promise);
+                    return JS_ThrowInternalError(ctx, "The runtime's completion queue is closed");
+                }
+            }
+            catch (...)
+            {
+                JS_FreeValue(ctx, promise);
+                return JS_ThrowOutOfMemory(ctx);
+            }
+
+            return promise;
+        }
+    };
+}
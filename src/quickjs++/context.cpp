@@ -1,7 +1,10 @@
 #include "context.h"
+#include "allocations.h"
 #include "runtime.h"
+#include "tracing.h"
 #include <algorithm>
 #include <fstream>
+#include <stdexcept>
 
 namespace qjs
 {
@@ -34,6 +37,236 @@ namespace qjs
 
             return "file://" + abspath;
         }
+
+        namespace
+        {
+            JSClassID lazy_prototype_class_id = 0;
+
+            struct lazy_prototype
+            {
+                std::function<void(value&)> define_members; // empty once run
+                // members of a prototype that was enumerated before its first use, see get_own_property_names
+                JSValue staging = JS_UNDEFINED;
+            };
+
+            lazy_prototype* get_lazy_prototype(JSValueConst obj)
+            {
+                return static_cast<lazy_prototype*>(JS_GetOpaque(obj, lazy_prototype_class_id));
+            }
+
+            /** Runs the pending member definitions of a lazy prototype on `target`.
+             *  If they fail, they stay pending, so that the next access tries again.
+             *  @return 1 if members were defined, 0 if there were none pending, -1 on exception.
+             */
+            int define_pending_members(JSContext* ctx, lazy_prototype* lazy, JSValueConst target)
+            {
+                if (!lazy || !lazy->define_members)
+                    return 0;
+
+                // cleared while running, so that lookups made while defining members don't recurse
+                std::function<void(value&)> define_members = std::move(lazy->define_members);
+                lazy->define_members = nullptr;
+
+                value proto(ctx, JS_DupValue(ctx, target));
+                int ret = exotic_call(ctx, [&] {
+                    define_members(proto);
+                    return 1;
+                });
+                if (ret < 0)
+                    lazy->define_members = std::move(define_members);
+                return ret;
+            }
+
+            int lazy_prototype_get_own_property(JSContext* ctx, JSPropertyDescriptor* desc, JSValueConst obj, JSAtom prop)
+            {
+                lazy_prototype* lazy = get_lazy_prototype(obj);
+                if (lazy && !JS_IsUndefined(lazy->staging))
+                    return JS_GetOwnProperty(ctx, desc, lazy->staging, prop);
+
+                int ret = define_pending_members(ctx, lazy, obj);
+                if (ret <= 0)
+                    return ret;
+                return JS_GetOwnProperty(ctx, desc, obj, prop);
+            }
+
+            int lazy_prototype_get_own_property_names(JSContext* ctx, JSPropertyEnum** ptab, uint32_t* plen, JSValueConst obj)
+            {
+                *ptab = nullptr;
+                *plen = 0;
+                lazy_prototype* lazy = get_lazy_prototype(obj);
+                if (!lazy)
+                    return 0;
+
+                // the engine counts an object's own properties before asking for these, so adding members to obj
+                // now would overrun its list; they go to an object of their own that the other hooks forward to
+                if (lazy->define_members)
+                {
+                    JSValue staging = JS_NewObjectProto(ctx, JS_NULL);
+                    if (JS_IsException(staging))
+                        return -1;
+                    if (define_pending_members(ctx, lazy, staging) < 0)
+                    {
+                        JS_FreeValue(ctx, staging);
+                        return -1;
+                    }
+                    lazy->staging = staging;
+                }
+
+                if (JS_IsUndefined(lazy->staging))
+                    return 0;
+                return JS_GetOwnPropertyNames(ctx, ptab, plen, lazy->staging, JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK);
+            }
+
+            int lazy_prototype_define_own_property(JSContext* ctx, JSValueConst obj, JSAtom prop, JSValueConst val,
+                                                   JSValueConst getter, JSValueConst setter, int flags)
+            {
+                lazy_prototype* lazy = get_lazy_prototype(obj);
+                if (lazy && !JS_IsUndefined(lazy->staging))
+                    return JS_DefineProperty(ctx, lazy->staging, prop, val, getter, setter, flags);
+
+                // members are defined first, so that they don't overwrite the new property later
+                if (define_pending_members(ctx, lazy, obj) < 0)
+                    return -1;
+                return JS_DefineProperty(ctx, obj, prop, val, getter, setter, flags | JS_PROP_NO_EXOTIC);
+            }
+
+            int lazy_prototype_delete_property(JSContext* ctx, JSValueConst obj, JSAtom prop)
+            {
+                lazy_prototype* lazy = get_lazy_prototype(obj);
+                if (lazy && !JS_IsUndefined(lazy->staging))
+                    return JS_DeleteProperty(ctx, lazy->staging, prop, 0);
+
+                // only reached for properties obj doesn't have yet, so a member has to exist before it can go
+                int ret = define_pending_members(ctx, lazy, obj);
+                if (ret <= 0)
+                    return ret < 0 ? -1 : 1;
+                return JS_DeleteProperty(ctx, obj, prop, 0);
+            }
+
+            JSClassExoticMethods lazy_prototype_exotic {
+                .get_own_property = lazy_prototype_get_own_property,
+                .get_own_property_names = lazy_prototype_get_own_property_names,
+                .delete_property = lazy_prototype_delete_property,
+                .define_own_property = lazy_prototype_define_own_property
+            };
+        }
+
+        JSValue new_lazy_prototype(JSContext* ctx)
+        {
+            JSRuntime* rt = JS_GetRuntime(ctx);
+            if (!lazy_prototype_class_id)
+                JS_NewClassID(rt, &lazy_prototype_class_id);
+
+            if (!JS_IsRegisteredClass(rt, lazy_prototype_class_id))
+            {
+                JSClassDef class_def {
+                    .class_name = "Object",
+                    .finalizer = [](JSRuntime* rt, JSValue val) noexcept {
+                        auto lazy = static_cast<lazy_prototype*>(JS_GetOpaque(val, lazy_prototype_class_id));
+                        JS_FreeValueRT(rt, lazy->staging);
+                        delete lazy;
+                    },
+                    .gc_mark = [](JSRuntime* rt, JSValueConst val, JS_MarkFunc* mark_func) {
+                        JS_MarkValue(rt, get_lazy_prototype(val)->staging, mark_func);
+                    },
+                    .exotic = &lazy_prototype_exotic
+                };
+
+                if (JS_NewClass(rt, lazy_prototype_class_id, &class_def) < 0)
+                    return JS_ThrowInternalError(ctx, "Could not register lazy prototype class");
+            }
+
+            JSValue proto = JS_NewObjectClass(ctx, lazy_prototype_class_id);
+            if (!JS_IsException(proto))
+                JS_SetOpaque(proto, new lazy_prototype);
+            return proto;
+        }
+
+        void defer_prototype_members(JSValueConst proto, std::function<void(value&)> define_members)
+        {
+            if (lazy_prototype* lazy = get_lazy_prototype(proto))
+                lazy->define_members = std::move(define_members);
+        }
+    }
+
+    object_builder::object_builder(JSContext* ctx, std::span<const std::string_view> keys) : m_ctx(ctx)
+    {
+        try
+        {
+            m_atoms.reserve(keys.size());
+            for (std::string_view key : keys)
+            {
+                JSAtom atom = JS_NewAtomLen(ctx, key.data(), key.size());
+                if (atom == JS_ATOM_NULL)
+                    throw exception(ctx);
+                if (std::ranges::find(m_atoms, atom) != m_atoms.end())
+                {
+                    JS_FreeAtom(ctx, atom);
+                    throw std::invalid_argument("object_builder: duplicate key " + std::string(key));
+                }
+                m_atoms.push_back(atom);
+            }
+        }
+        catch (...)
+        {
+            // the destructor doesn't run for a throwing constructor
+            for (JSAtom atom : m_atoms)
+                JS_FreeAtom(ctx, atom);
+            throw;
+        }
+    }
+
+    object_builder::~object_builder()
+    {
+        for (JSAtom atom : m_atoms)
+            JS_FreeAtom(m_ctx, atom);
+    }
+
+    value object_builder::make_from(std::span<JSValue> values)
+    {
+        auto free_values = [&](std::size_t from) {
+            for (std::size_t i = from; i < values.size(); ++i)
+                JS_FreeValue(m_ctx, values[i]);
+        };
+        if (std::ranges::any_of(values, [](JSValueConst v) { return JS_IsException(v); }))
+        {
+            free_values(0);
+            throw exception(m_ctx);
+        }
+        if (values.size() != m_atoms.size())
+        {
+            free_values(0);
+            throw std::invalid_argument("object_builder: expected " + std::to_string(m_atoms.size()) + " values, got " +
+                                        std::to_string(values.size()));
+        }
+
+    #if defined(QJS_VERSION_MAJOR) && (QJS_VERSION_MAJOR > 0 || QJS_VERSION_MINOR >= 10)
+        // builds the object's shape with all the properties in one step, and takes ownership of the values
+        JSValue obj = JS_NewObjectFrom(m_ctx, static_cast<int>(values.size()), m_atoms.data(), values.data());
+        if (JS_IsException(obj))
+        {
+            free_values(0);
+            throw exception(m_ctx);
+        }
+        return value(m_ctx, std::move(obj));
+    #else
+        value obj(m_ctx, JS_NewObject(m_ctx));
+        if (JS_IsException(obj.v))
+        {
+            free_values(0);
+            throw exception(m_ctx);
+        }
+        // defining skips the prototype chain lookup for setters that assignment does; each call takes its value
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            if (JS_DefinePropertyValue(m_ctx, obj.v, m_atoms[i], values[i], JS_PROP_C_W_E) < 0)
+            {
+                free_values(i + 1);
+                throw exception(m_ctx);
+            }
+        }
+        return obj;
+    #endif
     }
 
     context::context(runtime& rt) : context(rt.rt) {}
@@ -55,10 +288,15 @@ namespace qjs
         // We need to run the GC to flush finalization of any pending unhandled
         // rejected promises before we free the context, as they depend on it's
         // opaque value.
-        JS_RunGC(JS_GetRuntime(ctx));
+        JSRuntime* rt = JS_GetRuntime(ctx);
+        JS_RunGC(rt);
 
         m_modules.clear();
+        m_strings.reset();
         JS_FreeContext(ctx);
+
+        if (runtime* owner = runtime::get(rt); owner && owner->allocation_tracker())
+            owner->allocation_tracker()->context_freed(ctx);
     }
 
     module& context::add_module(const char* name)
@@ -69,6 +307,8 @@ namespace qjs
 
     value context::eval(std::string_view buffer, const char* filename, int flags)
     {
+        tracing::span span("eval", "qjs.eval", filename ? filename : "");
+        detail::allocation_scope allocations(ctx);
         JSValue v = JS_Eval(ctx, buffer.data(), buffer.size(), filename, flags);
 
         // For some time now module loads can return a (rejected) promise on
@@ -103,6 +343,13 @@ namespace qjs
         return value(ctx, JS_ParseJSON(ctx, buffer.data(), buffer.size(), filename));
     }
 
+    detail::string_cache& context::strings()
+    {
+        if (!m_strings)
+            m_strings = std::make_unique<detail::string_cache>(ctx);
+        return *m_strings;
+    }
+
     context& context::get(JSContext* ctx)
     {
         return *static_cast<context*>(JS_GetContextOpaque(ctx));
@@ -1,6 +1,10 @@
 #pragma once
+#include "exotic_methods.h"
 #include "value.h"
 #include <filesystem>
+#include <span>
+#include <tuple>
+#include <vector>
 
 namespace qjs
 {
@@ -8,8 +12,119 @@ namespace qjs
     {
         std::optional<std::string> read_file(const std::filesystem::path& filepath);
         std::string to_uri(std::string_view filename);
+
+        /** Creates an empty prototype object whose members can be deferred with defer_prototype_members. */
+        JSValue new_lazy_prototype(JSContext* ctx);
+
+        /** Defers defining the members of a prototype created by new_lazy_prototype.
+         *  `define_members` is run the first time a property of the prototype is looked up, defined, deleted or
+         *  enumerated; if it throws, it runs again on the next access. Enumeration can't add properties to the
+         *  object being enumerated, so the members of a prototype enumerated first live on a companion object
+         *  that its exotic methods forward to.
+         */
+        void defer_prototype_members(JSValueConst proto, std::function<void(value&)> define_members);
     }
 
+    /** Creates many objects with the same keys, e.g. to convert result rows. The keys are interned once, and each
+     *  object gets all its properties at once instead of growing one property at a time.
+     *  Must not outlive its context. Usually created with context::new_object_builder.
+     *  Example:
+     *  auto rows = context.new_object_builder({ "id", "name" });
+     *  qjs::value row = rows.make(1, "first");
+     */
+    class object_builder
+    {
+    public:
+        /** @throws std::invalid_argument if a key is repeated. */
+        object_builder(JSContext* ctx, std::span<const std::string_view> keys);
+        object_builder(JSContext* ctx, std::initializer_list<std::string_view> keys)
+            : object_builder(ctx, std::span(keys.begin(), keys.size())) {}
+
+        object_builder(object_builder&& other) noexcept
+            : m_ctx(other.m_ctx), m_atoms(std::move(other.m_atoms)) { other.m_atoms.clear(); }
+        object_builder(const object_builder&) = delete;
+
+        ~object_builder();
+
+        /** Number of keys. */
+        std::size_t size() const noexcept { return m_atoms.size(); }
+
+        /** Creates an object whose keys are set to `values`, in order.
+         *  @throws exception, or std::invalid_argument if the number of values isn't size().
+         */
+        template<typename... Args> requires (has_js_traits<std::decay_t<Args>> && ...)
+        value make(Args&&... values)
+        {
+            if constexpr (sizeof...(Args) == 0)
+            {
+                return make_from({});
+            }
+            else
+            {
+                // wrapped one by one, so that the values wrapped before a throwing conversion can be freed
+                JSValue wrapped[sizeof...(Args)];
+                std::size_t count = 0;
+                try
+                {
+                    ((wrapped[count] = js_traits<std::decay_t<Args>>::wrap(m_ctx, std::forward<Args>(values)), ++count), ...);
+                }
+                catch (...)
+                {
+                    for (std::size_t i = 0; i < count; ++i)
+                        JS_FreeValue(m_ctx, wrapped[i]);
+                    throw;
+                }
+                return make_from(wrapped);
+            }
+        }
+
+        /** Same as make() with the values of a range, e.g. a row whose columns are only known at runtime. */
+        template<std::ranges::input_range Range> requires has_js_traits<std::ranges::range_value_t<Range>>
+        value make_range(Range&& values)
+        {
+            using T = std::ranges::range_value_t<Range>;
+            std::vector<JSValue> wrapped;
+            wrapped.reserve(m_atoms.size());
+            try
+            {
+                for (auto&& val : values)
+                    wrapped.push_back(js_traits<T>::wrap(m_ctx, std::forward<decltype(val)>(val)));
+            }
+            catch (...)
+            {
+                for (JSValue v : wrapped)
+                    JS_FreeValue(m_ctx, v);
+                throw;
+            }
+            return make_from(wrapped);
+        }
+
+        /** Converts rows, each a tuple of one value per key, to an array of objects.
+         *  @throws exception
+         */
+        template<std::ranges::input_range Rows>
+        value make_array(const Rows& rows)
+        {
+            value array(m_ctx, JS_NewArray(m_ctx));
+            if (JS_IsException(array.v))
+                throw exception(m_ctx);
+            uint32_t index = 0;
+            for (const auto& row : rows)
+            {
+                value obj = std::apply([this](const auto&... values) { return make(values...); }, row);
+                if (JS_DefinePropertyValueUint32(m_ctx, array.v, index++, obj.release(), JS_PROP_C_W_E) < 0)
+                    throw exception(m_ctx);
+            }
+            return array;
+        }
+    private:
+        JSContext* m_ctx;
+        std::vector<JSAtom> m_atoms;
+
+        /** Creates the object, taking ownership of `values`, which may contain JS_EXCEPTION. */
+        value make_from(std::span<JSValue> values);
+    };
+
     /** Wrapper over JSContext * ctx
      *  Calls JS_SetContextOpaque(ctx, this); on construction and JS_FreeContext on destruction
      */
@@ -49,7 +164,7 @@ namespace qjs
         template<typename Function>
         void enqueue_job(Function&& job)
         {
-            JSValue job_val = js_traits<std::function<void()>>::wrap(ctx, std::forward<Function>(job));
+            JSValue job_val = js_traits<fwrapper<std::function<void()>>>::wrap(ctx, { std::forward<Function>(job), "job" });
             int err = JS_EnqueueJob(ctx, [](JSContext* ctx, int argc, JSValueConst* argv){
                 try
                 {
@@ -92,6 +207,12 @@ namespace qjs
             return value(ctx, JS_NewObject(ctx));
         }
 
+        /** Returns a builder of objects with the given keys, in order. @see object_builder */
+        object_builder new_object_builder(std::initializer_list<std::string_view> keys)
+        {
+            return object_builder(ctx, keys);
+        }
+
         /** Returns JS value converted from C++ object `val`. */
         template <typename T>
         value new_value(T&& val)
@@ -112,11 +233,12 @@ namespace qjs
          *  @tparam T Class type
          *  @param name Class name in JS engine
          *  @param proto JS class prototype or JS_UNDEFINED. Can be created with class_registrar.
+         *  @param exotic Exotic methods of the class or nullptr. Must outlive the runtime.
         */
         template <class T>
-        void register_class(const char* name, JSValue proto = JS_NULL)
+        void register_class(const char* name, JSValue proto = JS_NULL, JSClassExoticMethods* exotic = nullptr)
         {
-            js_traits<std::shared_ptr<T>>::register_class(ctx, name, proto);
+            js_traits<std::shared_ptr<T>>::register_class(ctx, name, proto, nullptr, exotic);
         }
 
         /// @see JS_Eval
@@ -124,13 +246,17 @@ namespace qjs
 
         value eval_file(const char* filename, int flags = 0);
 
-        /// @see JS_ParseJSON
+        /// @see JS_ParseJSON, and qjs::from_json to decode straight into C++ types
         value from_json(std::string_view buffer, const char* filename = "<fromJSON>");
 
+        /** Cache of JS strings created from short C++ strings, allocated on first use. */
+        detail::string_cache& strings();
+
         /** Get qjs::context from JSContext opaque pointer */
         static context& get(JSContext* ctx);
     private:
         std::vector<module> m_modules;
+        std::unique_ptr<detail::string_cache> m_strings;
 
         void init();
     };
@@ -157,10 +283,13 @@ namespace qjs
                 return add(name, js_traits<T>::wrap(m_ctx, std::forward<T>(value)));
         }
 
+        /** Register class T and export its constructors from this module.
+         *  @param lazy Defer creating the prototype members until the class is first used. See class_registrar.
+         */
         template<typename T> requires std::is_class_v<T>
-        class_registrar<T> register_class(const char* name)
+        class_registrar<T> register_class(const char* name, bool lazy = false)
         {
-            return class_registrar<T>(name, context::get(m_ctx), this);
+            return class_registrar<T>(name, context::get(m_ctx), this, lazy);
         }
     private:
         JSContext* m_ctx;
@@ -174,22 +303,37 @@ namespace qjs
     /** Helper class to register class members and constructors.
      *  See fun, constructor.
      *  Actual registration occurs at object destruction.
+     *  If lazy, prototype members are recorded and only created the first time the prototype's properties are
+     *  accessed, so classes that are never touched in a context cost little more than their constructors.
      */
     template<typename T> requires std::is_class_v<T>
     class class_registrar
     {
     public:
-        class_registrar(const char* name, context& context, module* module = nullptr)
+        class_registrar(const char* name, context& context, module* module = nullptr, bool lazy = false)
             : m_ctor(JS_NULL),
               m_context(context),
               m_module(module),
               m_name(name),
-              m_prototype(context.new_object()) {}
+              m_prototype(context.ctx, lazy ? detail::new_lazy_prototype(context.ctx) : JS_NewObject(context.ctx)),
+              m_lazy(lazy)
+        {
+            if (JS_IsException(m_prototype.v))
+                throw exception(context.ctx);
+        }
         class_registrar(const class_registrar&) = delete;
 
         ~class_registrar()
         {
-            m_context.register_class<T>(m_name, std::move(m_prototype));
+            if (m_lazy)
+            {
+                detail::defer_prototype_members(m_prototype.v, [members = std::move(m_members)](value& proto) {
+                    for (const auto& define_member : members)
+                        define_member(proto);
+                });
+            }
+
+            m_context.register_class<T>(m_name, std::move(m_prototype), m_exotic);
         }
 
         /** Sets the base class.
@@ -199,10 +343,10 @@ namespace qjs
             requires (std::is_class_v<B> && !std::same_as<B, T>)
         class_registrar& base()
         {
-            assert(js_traits<std::shared_ptr<B>>::QJSClassId && "base class is not registered");
-            js_traits<std::shared_ptr<T>>::template ensureCanCastToBase<B>();
+            assert(js_traits<std::shared_ptr<B>>::qjs_class_id && "base class is not registered");
+            js_traits<std::shared_ptr<T>>::template ensure_can_cast_to_base<B>(m_context.ctx);
 
-            JSValue base_proto = JS_GetClassProto(m_context.ctx, js_traits<std::shared_ptr<B>>::QJSClassId);
+            JSValue base_proto = JS_GetClassProto(m_context.ctx, js_traits<std::shared_ptr<B>>::qjs_class_id);
             int err = JS_SetPrototype(m_context.ctx, m_prototype.v, base_proto);
             JS_FreeValue(m_context.ctx, base_proto);
 
@@ -221,11 +365,23 @@ namespace qjs
         {
             if (!name)
                 name = m_name;
-            m_ctor = m_context.new_value(ctor_wrapper<T, Args...> { name });
-            JS_SetConstructor(m_context.ctx, m_ctor.v, m_prototype.v);
-            if (m_module)
-                m_module->add(name, value(m_ctor));
-            return *this;
+            return add_constructor(m_context.new_value(ctor_wrapper<T, Args...> { name }), name);
+        }
+
+        /** Add a class constructor that dispatches to one of several constructor overloads.
+         *  The overload is picked by number and types of arguments, in the order given.
+         *  Example:
+         *  module.register_class<T>("T").constructors<T(), T(int), T(const std::string&)>();
+         *  @tparam Signatures Constructor signatures written as function types
+         *  @param name Constructor name (if not specified, class name will be used)
+         */
+        template<typename... Signatures>
+            requires (sizeof...(Signatures) > 0 && (detail::is_constructor_signature<Signatures, T>::value && ...))
+        class_registrar& constructors(const char* name = nullptr)
+        {
+            if (!name)
+                name = m_name;
+            return add_constructor(m_context.new_value(ctor_overload_wrapper<T, Signatures...> { name }), name);
         }
 
         /** Add free function. */
@@ -234,7 +390,7 @@ namespace qjs
                       requires { &std::remove_reference_t<F>::operator(); })
         class_registrar& function(F&& f, const char* name)
         {
-            m_prototype[name] = std::forward<F>(f);
+            define([f = std::forward<F>(f), name](value& proto) { proto[name] = f; });
             return *this;
         }
 
@@ -249,19 +405,29 @@ namespace qjs
         }
 
         /** Add class member function or class member variable.
+         *  Several member functions can be given to create an overload set, picked by number and types of arguments.
          *  Example:
-         *  struct T { int var; int func(); }
+         *  struct T { int var; int func(); int func(int); }
          *  qjs::module& module = context.add_module("module");
-         *  module.register_class<T>("T").member<&T::var>("var").member<&T::func>("func");
+         *  module.register_class<T>("T").member<&T::var>("var")
+         *      .member<static_cast<int(T::*)()>(&T::func), static_cast<int(T::*)(int)>(&T::func)>("func");
          */
-        template<auto M> requires std::is_member_pointer_v<decltype(M)>
+        template<auto M, auto... Ms>
+            requires std::is_member_pointer_v<decltype(M)> &&
+                     (sizeof...(Ms) == 0 || (std::is_member_function_pointer_v<decltype(M)> &&
+                                             (std::is_member_function_pointer_v<decltype(Ms)> && ...)))
         class_registrar& member(const char* name)
         {
             js_traits<std::shared_ptr<T>>::template ensure_can_cast_to_base<M>(m_context.ctx);
-            if constexpr (std::is_member_function_pointer_v<decltype(M)>)
-                m_prototype[name] = fwrapper<decltype(M), true> { M, name };
-            else
-                m_prototype.add_member<M>(name);
+            (js_traits<std::shared_ptr<T>>::template ensure_can_cast_to_base<Ms>(m_context.ctx), ...);
+            define([name](value& proto) {
+                if constexpr (sizeof...(Ms) > 0)
+                    proto[name] = overload_wrapper<true, decltype(M), decltype(Ms)...> { { M, Ms... }, name };
+                else if constexpr (std::is_member_function_pointer_v<decltype(M)>)
+                    proto[name] = fwrapper<decltype(M), true> { M, name };
+                else
+                    proto.add_member<M>(name);
+            });
             return *this;
         }
 
@@ -272,12 +438,14 @@ namespace qjs
         template<auto FGet, auto FSet = nullptr>
         class_registrar& property(const char* name)
         {
-            js_traits<std::shared_ptr<T>>::template ensureCanCastToBase<FGet>();
-            js_traits<std::shared_ptr<T>>::template ensureCanCastToBase<FSet>();
-            if constexpr (std::is_null_pointer_v<decltype(FSet)>)
-                m_prototype.add_getter<FGet>(name);
-            else
-                m_prototype.add_getter_setter<FGet, FSet>(name);
+            js_traits<std::shared_ptr<T>>::template ensure_can_cast_to_base<FGet>(m_context.ctx);
+            js_traits<std::shared_ptr<T>>::template ensure_can_cast_to_base<FSet>(m_context.ctx);
+            define([name](value& proto) {
+                if constexpr (std::is_null_pointer_v<decltype(FSet)>)
+                    proto.add_getter<FGet>(name);
+                else
+                    proto.add_getter_setter<FGet, FSet>(name);
+            });
             return *this;
         }
 
@@ -294,11 +462,72 @@ namespace qjs
             m_ctor.add_member<M>(name);
             return *this;
         }
+
+        /** Set custom exotic methods for objects of this class.
+         *  @param methods Exotic methods. Must outlive the runtime.
+         */
+        class_registrar& exotic(JSClassExoticMethods* methods)
+        {
+            m_exotic = methods;
+            return *this;
+        }
+
+        /** Expose the elements of T as indexed properties, converted only when accessed.
+         *  Also adds `length` and makes objects iterable, so T behaves like a JS array without being copied into one.
+         *  Example:
+         *  module.register_class<std::vector<int>>("IntVector").indexed();
+         */
+        class_registrar& indexed() requires detail::indexed_container<T>
+        {
+            define([](value& proto) {
+                proto.add_getter<&detail::indexed_exotic<T>::length>("length");
+
+                value array_values = context::get(proto.ctx).global()["Array"]["prototype"]["values"];
+                if (JS_DefinePropertyValue(proto.ctx, proto.v, detail::get_symbol_iterator(proto.ctx),
+                                           array_values.release(), JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE) < 0)
+                {
+                    throw exception(proto.ctx);
+                }
+            });
+
+            return exotic(&detail::indexed_exotic<T>::methods);
+        }
+
+        /** Expose the entries of T as named properties, converted only when accessed.
+         *  Example:
+         *  module.register_class<std::map<std::string, int>>("IntMap").keyed();
+         */
+        class_registrar& keyed() requires detail::keyed_container<T>
+        {
+            return exotic(&detail::keyed_exotic<T>::methods);
+        }
     private:
         value m_ctor;
         context& m_context;
         module* m_module;
         const char* m_name;
         value m_prototype;
+        JSClassExoticMethods* m_exotic{};
+        bool m_lazy;
+        std::vector<std::function<void(value&)>> m_members;
+
+        class_registrar& add_constructor(value ctor, const char* name)
+        {
+            m_ctor = std::move(ctor);
+            JS_SetConstructor(m_context.ctx, m_ctor.v, m_prototype.v);
+            if (m_module)
+                m_module->add(name, value(m_ctor));
+            return *this;
+        }
+
+        /** Defines prototype members now, or records them for the first use of a lazy prototype. */
+        template<typename F>
+        void define(F&& define_member)
+        {
+            if (m_lazy)
+                m_members.emplace_back(std::forward<F>(define_member));
+            else
+                define_member(m_prototype);
+        }
     };
 }
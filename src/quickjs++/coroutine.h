@@ -0,0 +1,326 @@
+#pragma once
+#include "runtime.h"
+#include "value.h"
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace qjs
+{
+    template<typename T = void>
+    class task;
+
+    namespace detail
+    {
+        /** Promise type parts shared by task<T> for all T.
+         *  Tasks start eagerly. A task destroyed before completion is detached and frees itself when it finishes.
+         */
+        struct task_promise_base
+        {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+            bool detached = false;
+
+            struct final_awaiter
+            {
+                bool await_ready() const noexcept { return false; }
+
+                template<typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+                {
+                    task_promise_base& promise = handle.promise();
+                    if (promise.detached)
+                    {
+                        handle.destroy();
+                        return std::noop_coroutine();
+                    }
+                    return promise.continuation ? promise.continuation : std::noop_coroutine();
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+            final_awaiter final_suspend() const noexcept { return {}; }
+            void unhandled_exception() noexcept { exception = std::current_exception(); }
+        };
+
+        template<typename T>
+        struct task_promise : task_promise_base
+        {
+            std::optional<T> result;
+
+            task<T> get_return_object() noexcept;
+
+            template<typename U> requires std::convertible_to<U, T>
+            void return_value(U&& val) { result.emplace(std::forward<U>(val)); }
+        };
+
+        template<>
+        struct task_promise<void> : task_promise_base
+        {
+            task<void> get_return_object() noexcept;
+            void return_void() const noexcept {}
+        };
+    }
+
+    /** Coroutine type for C++ code that awaits JS promises.
+     *  Starts running immediately and is resumed by promise reaction jobs, i.e. by runtime::execute_pending_job.
+     *  Can itself be awaited from another task. If destroyed before finishing it keeps running detached,
+     *  and any exception it ends with is dropped.
+     *  Example:
+     *  qjs::task<int> fetch_length(qjs::context& ctx) {
+     *      qjs::value text = co_await ctx.eval("fetchText()");
+     *      co_return text.as<std::string_view>().size();
+     *  }
+     */
+    template<typename T>
+    class task
+    {
+    public:
+        using promise_type = detail::task_promise<T>;
+
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept : m_handle(handle) {}
+        task(task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+        task(const task&) = delete;
+
+        ~task()
+        {
+            if (!m_handle)
+                return;
+            if (m_handle.done())
+                m_handle.destroy();
+            else
+                m_handle.promise().detached = true;
+        }
+
+        task& operator=(task other) noexcept
+        {
+            std::swap(m_handle, other.m_handle);
+            return *this;
+        }
+
+        /** Whether the coroutine has finished. */
+        bool done() const noexcept { return !m_handle || m_handle.done(); }
+
+        /** Get the result of a finished task, rethrowing the exception it ended with if any. */
+        T get()
+        {
+            assert(m_handle && m_handle.done() && "task has not finished");
+            promise_type& promise = m_handle.promise();
+            if (promise.exception)
+                std::rethrow_exception(promise.exception);
+            if constexpr (!std::is_void_v<T>)
+                return std::move(*promise.result);
+        }
+
+        bool await_ready() const noexcept { return done(); }
+        void await_suspend(std::coroutine_handle<> continuation) noexcept { m_handle.promise().continuation = continuation; }
+        T await_resume() { return get(); }
+    private:
+        std::coroutine_handle<promise_type> m_handle;
+    };
+
+    template<typename T>
+    task<T> detail::task_promise<T>::get_return_object() noexcept
+    {
+        return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+    }
+
+    inline task<void> detail::task_promise<void>::get_return_object() noexcept
+    {
+        return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+    }
+
+    /** Awaiter for a JS promise, created by co_await on a qjs::value.
+     *  Settled promises and non-promise values complete without suspending. Otherwise the coroutine is resumed
+     *  from the promise's reaction job. A rejection is thrown as qjs::exception with the reason pending in the context.
+     */
+    class promise_awaiter
+    {
+    public:
+        explicit promise_awaiter(value promise) : m_promise(std::move(promise)) {}
+        promise_awaiter(const promise_awaiter&) = delete;
+
+        bool await_ready()
+        {
+            switch (JS_PromiseState(m_promise.ctx, m_promise.v))
+            {
+            case JS_PROMISE_NOT_A_PROMISE:
+                m_result = m_promise;
+                return true;
+            case JS_PROMISE_PENDING:
+                return false;
+            default:
+                settle(JS_PromiseResult(m_promise.ctx, m_promise.v),
+                       JS_PromiseState(m_promise.ctx, m_promise.v) == JS_PROMISE_REJECTED);
+                return true;
+            }
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            static const JSAtom then_atom = JS_NewAtom(m_promise.ctx, "then");
+
+            JSContext* ctx = m_promise.ctx;
+            m_handle = handle;
+
+            // the awaiter lives in the coroutine frame for as long as it is suspended, so no allocation is needed
+            JSCClosure* on_settled = [](JSContext* ctx, JSValueConst, int argc, JSValueConst* argv, int rejected, void* opaque) {
+                auto self = static_cast<promise_awaiter*>(opaque);
+                self->settle(JS_DupValue(ctx, argc > 0 ? argv[0] : JS_UNDEFINED), rejected);
+                self->m_handle.resume();
+                return JS_UNDEFINED;
+            };
+            JSCClosureFinalizerFunc* finalizer = [](void*) {};
+
+            JSValue callbacks[2] = {
+                JS_NewCClosure(ctx, on_settled, nullptr, finalizer, 1, false, this),
+                JS_NewCClosure(ctx, on_settled, nullptr, finalizer, 1, true, this)
+            };
+            JSValue result = JS_Invoke(ctx, m_promise.v, then_atom, 2, callbacks);
+            JS_FreeValue(ctx, callbacks[0]);
+            JS_FreeValue(ctx, callbacks[1]);
+
+            if (JS_IsException(result))
+                throw exception(ctx);
+            JS_FreeValue(ctx, result);
+        }
+
+        value await_resume()
+        {
+            if (m_rejected)
+            {
+                JS_Throw(m_result.ctx, m_result.release());
+                throw exception(m_promise.ctx);
+            }
+            return std::move(m_result);
+        }
+    private:
+        value m_promise;
+        value m_result { JS_UNDEFINED };
+        bool m_rejected = false;
+        std::coroutine_handle<> m_handle;
+
+        void settle(JSValue result, bool rejected)
+        {
+            m_result = value(m_promise.ctx, std::move(result));
+            m_rejected = rejected;
+        }
+    };
+
+    /** Await a JS promise (or any value, like the JS await operator) from a coroutine. */
+    inline promise_awaiter operator co_await(value promise)
+    {
+        return promise_awaiter(std::move(promise));
+    }
+
+    namespace detail
+    {
+        /** Awaits a task and settles a JS promise with its outcome through the promise's resolving functions.
+         *  The returned task is dropped by the caller, so this runs detached until the awaited task finishes.
+         */
+        template<typename T>
+        task<> settle_promise(JSContext* ctx, task<T> pending, value resolve, value reject)
+        {
+            JSValue result = JS_UNDEFINED;
+            bool rejected = false;
+            try
+            {
+                if constexpr (std::is_void_v<T>)
+                    co_await pending;
+                else
+                    result = js_traits<std::decay_t<T>>::wrap(ctx, co_await pending);
+                if (JS_IsException(result))
+                    throw exception(ctx);
+            }
+            catch (const exception&)
+            {
+                rejected = true;
+            }
+            catch (const std::exception& ex)
+            {
+                JS_ThrowInternalError(ctx, "%s", ex.what());
+                rejected = true;
+            }
+            catch (...)
+            {
+                JS_ThrowInternalError(ctx, "Unknown error");
+                rejected = true;
+            }
+
+            if (rejected)
+                result = JS_GetException(ctx);
+            JSValue ret = JS_Call(ctx, rejected ? reject.v : resolve.v, JS_UNDEFINED, 1, &result);
+            JS_FreeValue(ctx, result);
+            JS_FreeValue(ctx, ret);
+        }
+
+        /** Awaits a JS value and converts its settled result to T. */
+        template<typename T>
+        task<T> await_as(value promise)
+        {
+            value result = co_await std::move(promise);
+            if constexpr (!std::is_void_v<T>)
+                co_return result.as<T>();
+        }
+    }
+
+    /** Conversion traits for task<T> <-> JS promises.
+     *  A task returned from a bound function becomes a promise that settles when the task finishes,
+     *  so native code can co_await other promises instead of blocking the runtime thread.
+     *  A promise (or any value) passed to a task<T> parameter is awaited and converted to T.
+     */
+    template<typename T>
+    struct js_traits<task<T>>
+    {
+        static task<T> unwrap(JSContext* ctx, JSValueConst val)
+        {
+            return detail::await_as<T>(value(ctx, JS_DupValue(ctx, val)));
+        }
+
+        static JSValue wrap(JSContext* ctx, task<T> val) noexcept
+        {
+            JSValue resolving_funcs[2];
+            JSValue promise = JS_NewPromiseCapability(ctx, resolving_funcs);
+            if (JS_IsException(promise))
+                return promise;
+
+            try
+            {
+                detail::settle_promise(ctx, std::move(val), value(ctx, std::move(resolving_funcs[0])),
+                                       value(ctx, std::move(resolving_funcs[1])));
+            }
+            catch (...)
+            {
+                JS_FreeValue(ctx, promise);
+                return JS_ThrowOutOfMemory(ctx);
+            }
+
+            return promise;
+        }
+    };
+
+    /** Run pending jobs of a runtime until a task finishes, then return its result.
+     *  @throws std::runtime_error if the task is waiting but no job is pending.
+     */
+    template<typename T>
+    T sync_wait(runtime& runtime, task<T>& task)
+    {
+        while (!task.done())
+        {
+            if (!runtime.is_job_pending())
+                throw std::runtime_error("Task is waiting but no job is pending");
+            runtime.execute_pending_job();
+        }
+        return task.get();
+    }
+
+    template<typename T>
+    T sync_wait(runtime& runtime, task<T>&& task)
+    {
+        return sync_wait(runtime, task);
+    }
+}
@@ -0,0 +1,327 @@
+#include "event_loop.h"
+#include "allocations.h"
+#include "completion_queue.h"
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
+namespace qjs
+{
+    namespace
+    {
+        int to_timeout_ms(std::optional<event_loop::clock::duration> timeout)
+        {
+            if (!timeout)
+                return -1;
+            // round up, so that a timer isn't polled for again just before it is due
+            auto ms = std::chrono::ceil<std::chrono::milliseconds>(std::max(*timeout, event_loop::clock::duration::zero()));
+            return static_cast<int>(std::min<std::chrono::milliseconds::rep>(ms.count(), INT32_MAX));
+        }
+    }
+
+    event_loop::event_loop(runtime& runtime) : m_runtime(runtime)
+    {
+        #ifdef __linux__
+        if ((m_poll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+            throw std::runtime_error("Cannot create epoll instance");
+
+        epoll_event ev { .events = EPOLLIN, .data = { .fd = m_runtime.completions()->fd() } };
+        if (epoll_ctl(m_poll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+        {
+            ::close(m_poll_fd);
+            throw std::runtime_error("Cannot watch completion queue");
+        }
+        #endif
+    }
+
+    event_loop::~event_loop()
+    {
+        // timers hold JS values, which must be freed before the runtime
+        m_timers.clear();
+
+        #ifdef __linux__
+        ::close(m_poll_fd);
+        #endif
+    }
+
+    void event_loop::install(context& context)
+    {
+        JSContext* ctx = context.ctx;
+        auto timer_function = [this, &context, ctx](bool repeat) {
+            return [this, &context, ctx, repeat](value callback, rest<value> args) {
+                if (!JS_IsFunction(ctx, callback.v))
+                {
+                    JS_ThrowTypeError(ctx, "Timer callback must be a function");
+                    throw exception(ctx);
+                }
+
+                double delay = args.empty() ? 0 : args.front().as<double>();
+                std::vector<value> call_args(args.begin() + std::min<std::size_t>(args.size(), 1), args.end());
+
+                // like Node.js, delays below 1ms (including NaN) are treated as 1ms
+                auto duration = std::chrono::duration<double, std::milli>(delay >= 1 ? delay : 1);
+                return set_timer(context, [ctx, callback = std::move(callback), call_args = std::move(call_args)] {
+                    std::vector<JSValue> argv;
+                    argv.reserve(call_args.size());
+                    for (const value& arg : call_args)
+                        argv.push_back(arg.v);
+
+                    JSValue result = JS_Call(ctx, callback.v, JS_UNDEFINED, static_cast<int>(argv.size()), argv.data());
+                    if (JS_IsException(result))
+                        throw exception(ctx);
+                    JS_FreeValue(ctx, result);
+                }, std::chrono::duration_cast<clock::duration>(duration), repeat);
+            };
+        };
+
+        auto clear_function = [this](rest<int64_t> ids) {
+            if (!ids.empty())
+                clear_timer(ids.front());
+        };
+
+        value global = context.global();
+        global["setTimeout"] = fwrapper { timer_function(false), "setTimeout" };
+        global["setInterval"] = fwrapper { timer_function(true), "setInterval" };
+        global["clearTimeout"] = fwrapper { clear_function, "clearTimeout" };
+        global["clearInterval"] = fwrapper { clear_function, "clearInterval" };
+    }
+
+    int64_t event_loop::set_timer(context& context, std::function<void()> callback, clock::duration delay, bool repeat)
+    {
+        int64_t id = m_next_timer_id++;
+        m_timers.emplace(id, timer { context.ctx, std::move(callback), delay, repeat });
+        push_timer({ clock::now() + delay, id });
+        return id;
+    }
+
+    void event_loop::clear_timer(int64_t id)
+    {
+        // the heap entry stays until it is due and is skipped then, unless cleared timers come to outnumber live ones,
+        // e.g. when a long timeout is set and cleared for every request
+        if (m_timers.erase(id) && m_timer_heap.size() > 2 * m_timers.size() + 64)
+            compact_timers();
+    }
+
+    void event_loop::watch(int fd, int events, std::function<void(int)> callback)
+    {
+        #ifdef __linux__
+        epoll_event ev { .events = 0, .data = { .fd = fd } };
+        if (events & readable)
+            ev.events |= EPOLLIN;
+        if (events & writable)
+            ev.events |= EPOLLOUT;
+
+        int op = m_watchers.contains(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(m_poll_fd, op, fd, &ev) < 0)
+            throw std::runtime_error("Cannot watch file descriptor");
+        #elif defined(_WIN32)
+        throw std::runtime_error("File descriptor watchers are not supported on this platform");
+        #endif
+
+        m_watchers.insert_or_assign(fd, std::pair(events, std::move(callback)));
+    }
+
+    void event_loop::unwatch(int fd)
+    {
+        if (!m_watchers.erase(fd))
+            return;
+
+        #ifdef __linux__
+        epoll_ctl(m_poll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        #endif
+    }
+
+    bool event_loop::run_once(std::optional<clock::duration> max_wait)
+    {
+        run_jobs();
+        fire_timers();
+        if (!alive())
+            return false;
+
+        std::optional<clock::duration> timeout = max_wait;
+        if (m_runtime.is_job_pending())
+        {
+            timeout = clock::duration::zero();
+        }
+        else if (std::optional<clock::time_point> deadline = next_deadline())
+        {
+            clock::duration until_timer = *deadline - clock::now();
+            if (!timeout || until_timer < *timeout)
+                timeout = until_timer;
+        }
+
+        poll(timeout);
+        fire_timers();
+        return alive();
+    }
+
+    void event_loop::run()
+    {
+        m_stopped = false;
+        while (!m_stopped && run_once()) {}
+    }
+
+    bool event_loop::alive() const
+    {
+        return !m_timers.empty() || !m_watchers.empty() || m_runtime.is_job_pending() || m_runtime.completions()->held() > 0;
+    }
+
+    void event_loop::run_jobs()
+    {
+        m_runtime.completions()->drain();
+        while (m_runtime.is_job_pending())
+            m_runtime.execute_pending_job();
+    }
+
+    void event_loop::push_timer(timer_entry entry)
+    {
+        m_timer_heap.push_back(entry);
+        std::ranges::push_heap(m_timer_heap, std::greater<>());
+    }
+
+    event_loop::timer_entry event_loop::pop_timer()
+    {
+        std::ranges::pop_heap(m_timer_heap, std::greater<>());
+        timer_entry entry = m_timer_heap.back();
+        m_timer_heap.pop_back();
+        return entry;
+    }
+
+    std::optional<event_loop::clock::time_point> event_loop::next_deadline()
+    {
+        // entries of cleared timers are dropped, so that they don't cut the wait for live ones short
+        while (!m_timer_heap.empty() && !m_timers.contains(m_timer_heap.front().id))
+            pop_timer();
+        if (m_timer_heap.empty())
+            return std::nullopt;
+        return m_timer_heap.front().deadline;
+    }
+
+    void event_loop::compact_timers()
+    {
+        std::erase_if(m_timer_heap, [this](const timer_entry& entry) { return !m_timers.contains(entry.id); });
+        std::ranges::make_heap(m_timer_heap, std::greater<>());
+    }
+
+    void event_loop::fire_timers()
+    {
+        clock::time_point now = clock::now();
+        while (!m_timer_heap.empty() && m_timer_heap.front().deadline <= now)
+        {
+            timer_entry entry = pop_timer();
+
+            auto it = m_timers.find(entry.id);
+            if (it == m_timers.end())
+                continue;
+
+            // the callback may clear its own timer, so it is taken out of the table while it runs
+            std::function<void()> callback = std::move(it->second.callback);
+            JSContext* ctx = it->second.ctx;
+            bool repeat = it->second.repeat;
+            clock::duration interval = it->second.interval;
+            if (!repeat)
+                m_timers.erase(it);
+
+            auto reschedule = [&] {
+                auto it = m_timers.find(entry.id);
+                if (!repeat || it == m_timers.end())
+                    return;
+                it->second.callback = std::move(callback);
+                push_timer({ std::max(entry.deadline + interval, clock::now()), entry.id });
+            };
+
+            try
+            {
+                detail::allocation_scope allocations(ctx);
+                callback();
+            }
+            catch (...)
+            {
+                reschedule();
+                throw;
+            }
+
+            reschedule();
+            run_jobs();
+        }
+    }
+
+    void event_loop::poll(std::optional<clock::duration> timeout)
+    {
+        int timeout_ms = to_timeout_ms(timeout);
+        int completions_fd = m_runtime.completions()->fd();
+
+        #ifdef __linux__
+        epoll_event events[64];
+        int count = epoll_wait(m_poll_fd, events, std::size(events), timeout_ms);
+        for (int i = 0; i < count; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == completions_fd)
+            {
+                run_jobs();
+                continue;
+            }
+
+            auto it = m_watchers.find(fd);
+            if (it == m_watchers.end())
+                continue;
+
+            int ready = ((events[i].events & EPOLLIN) ? readable : 0) |
+                        ((events[i].events & EPOLLOUT) ? writable : 0) |
+                        ((events[i].events & (EPOLLERR | EPOLLHUP)) ? error : 0);
+
+            // copied, since the callback may unwatch its own fd
+            std::function<void(int)> callback = it->second.second;
+            callback(ready);
+            run_jobs();
+        }
+        #elif !defined(_WIN32)
+        std::vector<pollfd> fds;
+        fds.reserve(m_watchers.size() + 1);
+        fds.push_back({ .fd = completions_fd, .events = POLLIN, .revents = 0 });
+        for (const auto& [fd, watcher] : m_watchers)
+        {
+            short events = ((watcher.first & readable) ? POLLIN : 0) | ((watcher.first & writable) ? POLLOUT : 0);
+            fds.push_back({ .fd = fd, .events = events, .revents = 0 });
+        }
+
+        if (::poll(fds.data(), fds.size(), timeout_ms) <= 0)
+            return;
+
+        for (const pollfd& p : fds)
+        {
+            if (!p.revents)
+                continue;
+            if (p.fd == completions_fd)
+            {
+                run_jobs();
+                continue;
+            }
+
+            auto it = m_watchers.find(p.fd);
+            if (it == m_watchers.end())
+                continue;
+
+            int ready = ((p.revents & POLLIN) ? readable : 0) |
+                        ((p.revents & POLLOUT) ? writable : 0) |
+                        ((p.revents & (POLLERR | POLLHUP | POLLNVAL)) ? error : 0);
+
+            std::function<void(int)> callback = it->second.second;
+            callback(ready);
+            run_jobs();
+        }
+        #else
+        // no pollable completion fd here, so wake up regularly to drain the completion queue
+        constexpr clock::duration max_sleep = std::chrono::milliseconds(10);
+        std::this_thread::sleep_for(timeout ? std::min(*timeout, max_sleep) : max_sleep);
+        run_jobs();
+        #endif
+    }
+}
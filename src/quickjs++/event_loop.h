@@ -0,0 +1,114 @@
+#pragma once
+#include "context.h"
+#include "runtime.h"
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+namespace qjs
+{
+    /** Optional event loop driving a runtime: timers, job draining and fd watchers.
+     *  One iteration (run_once) drains the runtime's completion_queue, fires due timers and waits on watched
+     *  file descriptors (epoll on Linux, poll elsewhere) until the next timer is due, running all pending jobs
+     *  after every callback. install() exposes setTimeout/setInterval/clearTimeout/clearInterval to a context.
+     *  Must be destroyed before the runtime and outlive the contexts it is installed into.
+     *  Example:
+     *  qjs::event_loop loop(runtime);
+     *  loop.install(context);
+     *  context.eval("setTimeout(() => console.log('done'), 100)");
+     *  loop.run();
+     */
+    class event_loop
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        /** Events reported to fd watchers. */
+        enum event : int
+        {
+            readable = 1,
+            writable = 2,
+            error = 4
+        };
+
+        explicit event_loop(runtime& runtime);
+        event_loop(const event_loop&) = delete;
+        ~event_loop();
+
+        /** Define the timer functions as globals of a context. */
+        void install(context& context);
+
+        /** Call `callback` after `delay`, and then every `delay` if `repeat` is set.
+         *  @return Timer id for clear_timer, never 0.
+         */
+        int64_t set_timer(context& context, std::function<void()> callback, clock::duration delay, bool repeat = false);
+
+        /** Cancel a timer. Unknown and already fired ids are ignored. */
+        void clear_timer(int64_t id);
+
+        /** Call `callback` with a mask of `event`s whenever `fd` is ready for any of `events`.
+         *  Replaces an existing watcher of the same fd.
+         */
+        void watch(int fd, int events, std::function<void(int)> callback);
+
+        /** Stop watching `fd`. */
+        void unwatch(int fd);
+
+        /** Run a single iteration, waiting at most `max_wait` for timers or fds (forever if not set).
+         *  @return Whether there is anything left to wait for.
+         *  @throws exception if a callback or job throws; the loop stays usable.
+         */
+        bool run_once(std::optional<clock::duration> max_wait = std::nullopt);
+
+        /** Run iterations until nothing is left to wait for or stop() is called. */
+        void run();
+
+        /** Make run() return after the current iteration. */
+        void stop() noexcept { m_stopped = true; }
+
+        /** Whether timers, watchers, pending jobs or promises waiting on other threads remain. */
+        bool alive() const;
+
+        /** File descriptor that becomes readable when the loop has work, for nesting it in another loop.
+         *  -1 where the platform has no pollable multiplexer.
+         */
+        int fd() const noexcept { return m_poll_fd; }
+    private:
+        struct timer
+        {
+            JSContext* ctx;
+            std::function<void()> callback;
+            clock::duration interval;
+            bool repeat;
+        };
+
+        struct timer_entry
+        {
+            clock::time_point deadline;
+            int64_t id;
+
+            bool operator>(const timer_entry& other) const noexcept
+            {
+                return deadline != other.deadline ? deadline > other.deadline : id > other.id;
+            }
+        };
+
+        runtime& m_runtime;
+        std::unordered_map<int64_t, timer> m_timers;
+        // min-heap on deadline; entries of cleared timers stay until they are due or the heap is compacted
+        std::vector<timer_entry> m_timer_heap;
+        int64_t m_next_timer_id = 1;
+
+        std::unordered_map<int, std::pair<int, std::function<void(int)>>> m_watchers;
+        int m_poll_fd = -1;
+        bool m_stopped = false;
+
+        void run_jobs();
+        void push_timer(timer_entry entry);
+        timer_entry pop_timer();
+        std::optional<clock::time_point> next_deadline();
+        void compact_timers();
+        void fire_timers();
+        void poll(std::optional<clock::duration> timeout);
+    };
+}
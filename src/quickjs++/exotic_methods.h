@@ -0,0 +1,279 @@
+#pragma once
+#include "js_traits.h"
+#include <algorithm>
+
+namespace qjs
+{
+    namespace detail
+    {
+        /** Concept satisfied by containers that can be exposed as lazily converted JS arrays. */
+        template<typename T>
+        concept indexed_container =
+            std::ranges::random_access_range<T> && std::ranges::sized_range<T> &&
+            has_js_traits<std::ranges::range_value_t<T>>;
+
+        /** Concept satisfied by string-keyed mapped containers that can be exposed as lazily converted JS objects. */
+        template<typename T>
+        concept keyed_container = requires(T& container, const typename T::key_type& key) {
+            typename T::mapped_type;
+            { container.find(key) } -> std::same_as<std::ranges::iterator_t<T>>;
+            container.erase(container.find(key));
+        } && std::same_as<std::remove_const_t<typename T::key_type>, std::string> && has_js_traits<typename T::mapped_type>;
+
+        /** Converts an atom to an array index.
+         *  QuickJS canonicalizes integer keys up to 2^31 - 1 into tagged atoms, so no string parsing is needed.
+         */
+        inline bool atom_to_index(JSAtom atom, uint32_t& index) noexcept
+        {
+            constexpr JSAtom atom_tag_int = 1U << 31;
+            if (!(atom & atom_tag_int))
+                return false;
+            index = atom & ~atom_tag_int;
+            return true;
+        }
+
+        /** Runs an exotic method body, converting C++ exceptions into a pending JS exception and -1. */
+        template<typename F>
+        int exotic_call(JSContext* ctx, F&& f) noexcept
+        {
+            try
+            {
+                return f();
+            }
+            catch (const exception&)
+            {
+                return -1;
+            }
+            catch (const std::exception& ex)
+            {
+                JS_ThrowInternalError(ctx, "%s", ex.what());
+                return -1;
+            }
+            catch (...)
+            {
+                JS_ThrowInternalError(ctx, "Unknown error");
+                return -1;
+            }
+        }
+
+        /** Gets the native object behind a JS object of registered class T. */
+        template<typename T>
+        T* get_native(JSValueConst obj) noexcept
+        {
+            auto pptr = static_cast<std::shared_ptr<T>*>(JS_GetOpaque(obj, js_traits<std::shared_ptr<T>>::qjs_class_id));
+            return pptr ? pptr->get() : nullptr;
+        }
+
+        /** Exotic methods exposing the elements of a random access container as indexed properties.
+         *  Elements are converted only when accessed, so no JS array is ever materialized.
+         */
+        template<indexed_container T>
+        struct indexed_exotic
+        {
+            using value_type = std::ranges::range_value_t<T>;
+            static constexpr bool writable = std::indirectly_writable<std::ranges::iterator_t<T>, value_type>;
+
+            static std::size_t length(const std::shared_ptr<T>& self)
+            {
+                return std::ranges::size(*self);
+            }
+
+            static int get_own_property(JSContext* ctx, JSPropertyDescriptor* desc, JSValueConst obj, JSAtom prop)
+            {
+                uint32_t index;
+                T* container = get_native<T>(obj);
+                if (!container || !atom_to_index(prop, index) || index >= std::ranges::size(*container))
+                    return false;
+                if (!desc)
+                    return true;
+
+                return exotic_call(ctx, [&] {
+                    JSValue val = js_traits<value_type>::wrap(ctx, std::ranges::begin(*container)[index]);
+                    if (JS_IsException(val))
+                        return -1;
+                    desc->flags = JS_PROP_ENUMERABLE | (writable ? JS_PROP_WRITABLE : 0);
+                    desc->value = val;
+                    desc->getter = JS_UNDEFINED;
+                    desc->setter = JS_UNDEFINED;
+                    return 1;
+                });
+            }
+
+            static int get_own_property_names(JSContext* ctx, JSPropertyEnum** ptab, uint32_t* plen, JSValueConst obj)
+            {
+                T* container = get_native<T>(obj);
+                uint32_t length = container ? static_cast<uint32_t>(std::ranges::size(*container)) : 0;
+
+                *ptab = static_cast<JSPropertyEnum*>(js_malloc(ctx, sizeof(JSPropertyEnum) * std::max(length, 1u)));
+                if (!*ptab)
+                    return -1;
+
+                for (uint32_t i = 0; i < length; ++i)
+                    (*ptab)[i] = { .is_enumerable = true, .atom = JS_NewAtomUInt32(ctx, i) };
+                *plen = length;
+                return 0;
+            }
+
+            static int define_own_property(JSContext* ctx, JSValueConst this_obj, JSAtom prop,
+                                           JSValueConst val, JSValueConst getter, JSValueConst setter, int flags)
+            {
+                uint32_t index;
+                if (!atom_to_index(prop, index))
+                    return JS_DefineProperty(ctx, this_obj, prop, val, getter, setter, flags | JS_PROP_NO_EXOTIC);
+
+                T* container = get_native<T>(this_obj);
+                if constexpr (writable)
+                {
+                    if (container && index < std::ranges::size(*container) && (flags & JS_PROP_HAS_VALUE))
+                    {
+                        return exotic_call(ctx, [&] {
+                            std::ranges::begin(*container)[index] = js_traits<value_type>::unwrap(ctx, val);
+                            return 1;
+                        });
+                    }
+                }
+
+                JS_ThrowTypeError(ctx, "Cannot define index %u of native container", index);
+                return -1;
+            }
+
+            inline static JSClassExoticMethods methods {
+                .get_own_property = get_own_property,
+                .get_own_property_names = get_own_property_names,
+                .define_own_property = define_own_property
+            };
+        };
+
+        /** Exotic methods exposing the entries of a mapped container as named properties.
+         *  Entries are converted only when accessed, so no JS object is ever materialized.
+         */
+        template<keyed_container T>
+        struct keyed_exotic
+        {
+            using key_type = std::remove_const_t<typename T::key_type>;
+            using mapped_type = typename T::mapped_type;
+            static constexpr bool writable = requires(T& container, key_type key, mapped_type mapped) {
+                container.insert_or_assign(std::move(key), std::move(mapped));
+            };
+
+            /** Looks up the entry for an atom. Symbols never map to entries. */
+            static std::ranges::iterator_t<T> find(JSContext* ctx, T& container, JSAtom prop)
+            {
+                JSValue key = JS_AtomToValue(ctx, prop);
+                if (JS_IsSymbol(key))
+                {
+                    JS_FreeValue(ctx, key);
+                    return container.end();
+                }
+                return container.find(unwrap_free<key_type>(ctx, key));
+            }
+
+            static int get_own_property(JSContext* ctx, JSPropertyDescriptor* desc, JSValueConst obj, JSAtom prop)
+            {
+                T* container = get_native<T>(obj);
+                if (!container)
+                    return false;
+
+                return exotic_call(ctx, [&] {
+                    auto it = find(ctx, *container, prop);
+                    if (it == container->end())
+                        return 0;
+                    if (!desc)
+                        return 1;
+
+                    JSValue val = js_traits<mapped_type>::wrap(ctx, it->second);
+                    if (JS_IsException(val))
+                        return -1;
+                    desc->flags = JS_PROP_ENUMERABLE | JS_PROP_CONFIGURABLE | (writable ? JS_PROP_WRITABLE : 0);
+                    desc->value = val;
+                    desc->getter = JS_UNDEFINED;
+                    desc->setter = JS_UNDEFINED;
+                    return 1;
+                });
+            }
+
+            static int get_own_property_names(JSContext* ctx, JSPropertyEnum** ptab, uint32_t* plen, JSValueConst obj)
+            {
+                T* container = get_native<T>(obj);
+                uint32_t length = container ? static_cast<uint32_t>(std::ranges::size(*container)) : 0;
+
+                *ptab = static_cast<JSPropertyEnum*>(js_malloc(ctx, sizeof(JSPropertyEnum) * std::max(length, 1u)));
+                if (!*ptab)
+                    return -1;
+
+                uint32_t i = 0;
+                int ret = !container ? 0 : exotic_call(ctx, [&] {
+                    for (auto it = container->begin(); i < length; ++it, ++i)
+                    {
+                        JSValue key = js_traits<key_type>::wrap(ctx, it->first);
+                        if (JS_IsException(key))
+                            return -1;
+                        (*ptab)[i] = { .is_enumerable = true, .atom = JS_ValueToAtom(ctx, key) };
+                        JS_FreeValue(ctx, key);
+                    }
+                    return 0;
+                });
+
+                if (ret < 0)
+                {
+                    for (uint32_t j = 0; j < i; ++j)
+                        JS_FreeAtom(ctx, (*ptab)[j].atom);
+                    js_free(ctx, *ptab);
+                    return -1;
+                }
+
+                *plen = length;
+                return 0;
+            }
+
+            static int define_own_property(JSContext* ctx, JSValueConst this_obj, JSAtom prop,
+                                           JSValueConst val, JSValueConst getter, JSValueConst setter, int flags)
+            {
+                T* container = get_native<T>(this_obj);
+                JSValue key = JS_AtomToValue(ctx, prop);
+                if (!container || JS_IsSymbol(key))
+                {
+                    JS_FreeValue(ctx, key);
+                    return JS_DefineProperty(ctx, this_obj, prop, val, getter, setter, flags | JS_PROP_NO_EXOTIC);
+                }
+
+                if constexpr (writable)
+                {
+                    if (flags & JS_PROP_HAS_VALUE)
+                    {
+                        return exotic_call(ctx, [&] {
+                            key_type unwrapped = unwrap_free<key_type>(ctx, key);
+                            container->insert_or_assign(std::move(unwrapped), js_traits<mapped_type>::unwrap(ctx, val));
+                            return 1;
+                        });
+                    }
+                }
+
+                JS_FreeValue(ctx, key);
+                JS_ThrowTypeError(ctx, "Cannot define entry of native container");
+                return -1;
+            }
+
+            static int delete_property(JSContext* ctx, JSValueConst obj, JSAtom prop)
+            {
+                T* container = get_native<T>(obj);
+                if (!container)
+                    return true;
+
+                return exotic_call(ctx, [&] {
+                    auto it = find(ctx, *container, prop);
+                    if (it != container->end())
+                        container->erase(it);
+                    return 1;
+                });
+            }
+
+            inline static JSClassExoticMethods methods {
+                .get_own_property = get_own_property,
+                .get_own_property_names = get_own_property_names,
+                .delete_property = delete_property,
+                .define_own_property = define_own_property
+            };
+        };
+    }
+}
@@ -1,7 +1,14 @@
 #pragma once
+#include "allocations.h"
 #include "exception.h"
 #include "function_traits.h"
+#include "instrumentation.h"
 #include "utility.h"
+#include <functional>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <string_view>
 
 namespace qjs
 {
@@ -58,8 +65,9 @@ namespace qjs
             }
         }
 
+        /** Unwraps the JS arguments of a call of `Function`, including the owner of member functions, into a tuple. */
         template<bool PassThis, typename Function>
-        auto apply_unwrapped(Function&& f, JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
+        auto unwrap_call_args(JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
         {
             using Traits = function_traits<Function>;
             using Args = typename Traits::args;
@@ -68,66 +76,228 @@ namespace qjs
                 using Owner = typename Traits::owner_type;
                 if constexpr (PassThis)
                 {
-                    return std::apply(std::forward<Function>(f), std::tuple_cat(
+                    return std::tuple_cat(
                         std::make_tuple(unwrap_arg_impl<Owner, 0, 1>::unwrap(ctx, 1, &this_val)),
                         unwrap_args<Args>(ctx, argc, argv)
-                    ));
+                    );
                 }
                 else
                 {
-                    return std::apply(std::forward<Function>(f), std::tuple_cat(
+                    return std::tuple_cat(
                         std::make_tuple(unwrap_arg_impl<Owner, 0, 1>::unwrap(ctx, 1, &argv[0])),
                         unwrap_args<Args>(ctx, argc - 1, argv + 1)
-                    ));
+                    );
                 }
             }
             else if constexpr (PassThis)
             {
                 using FirstArg = std::decay_t<std::tuple_element_t<0, Args>>;
-                return std::apply(std::forward<Function>(f), std::tuple_cat(
+                return std::tuple_cat(
                     std::make_tuple(unwrap_arg_impl<FirstArg, 0, 1>::unwrap(ctx, 1, &this_val)),
                     unwrap_args<Args, 1>(ctx, argc, argv)
-                ));
+                );
             }
             else
             {
-                return std::apply(std::forward<Function>(f), unwrap_args<Args>(ctx, argc, argv));
+                return unwrap_args<Args>(ctx, argc, argv);
             }
         }
 
+        /** Calls a C++ function with JS arguments and converts the result to JS.
+         *  C++ exceptions are converted to JS exceptions.
+         *  Allocations during the call are attributed to ctx and the binding (see allocations).
+         *  @param binding Instrumentation id of the binding (see detail::binding_id), 0 if untracked.
+         */
         template<bool PassThis, typename Function>
-        JSValue wrap_call(JSContext* ctx, Function&& f, JSValueConst this_val, int argc, JSValueConst* argv)
+        JSValue wrap_call(JSContext* ctx, Function&& f, JSValueConst this_val, int argc, JSValueConst* argv, int binding = 0)
         {
             using R = typename function_traits<Function>::result_type;
+            allocation_scope allocations(ctx, binding);
+            call_timer timer(binding);
             try
             {
+                auto args = unwrap_call_args<PassThis, Function>(ctx, this_val, argc, argv);
+                timer.converted();
                 if constexpr (std::is_void_v<R>)
                 {
-                    apply_unwrapped<PassThis>(std::forward<Function>(f), ctx, this_val, argc, argv);
+                    std::apply(std::forward<Function>(f), std::move(args));
+                    timer.returned();
                     return JS_NULL;
                 }
                 else
                 {
-                    return js_traits<std::decay_t<R>>::wrap(ctx,
-                        apply_unwrapped<PassThis>(std::forward<Function>(f), ctx, this_val, argc, argv));
+                    decltype(auto) result = std::apply(std::forward<Function>(f), std::move(args));
+                    timer.returned();
+                    JSValue val = js_traits<std::decay_t<R>>::wrap(ctx, std::forward<decltype(result)>(result));
+                    if (JS_IsException(val))
+                        timer.failed();
+                    return val;
                 }
             }
             catch (const exception&)
             {
+                timer.failed();
                 return JS_EXCEPTION;
             }
             catch (const std::exception& ex)
             {
+                timer.failed();
                 JS_ThrowInternalError(ctx, "%s", ex.what());
                 return JS_EXCEPTION;
             }
             catch (...)
             {
+                timer.failed();
                 JS_ThrowInternalError(ctx, "Unknown error");
                 return JS_EXCEPTION;
             }
         }
 
+        /** Cheap check of whether a JS value could be unwrapped into T, used to pick between overloads.
+         *  Only looks at the value's tag and class ID; types it knows nothing about always match.
+         */
+        template<typename T>
+        bool matches_js_type(JSContext* ctx, JSValueConst val)
+        {
+            if constexpr (std::same_as<T, bool>)
+            {
+                return JS_IsBool(val);
+            }
+            else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+            {
+                return JS_IsNumber(val);
+            }
+            else if constexpr (std::convertible_to<T, std::string_view>)
+            {
+                return JS_IsString(val);
+            }
+            else if constexpr (is_specialization_of_v<T, std::optional>)
+            {
+                return JS_IsNull(val) || JS_IsUndefined(val) || matches_js_type<typename T::value_type>(ctx, val);
+            }
+            else if constexpr (is_specialization_of_v<T, std::shared_ptr> ||
+                               (std::is_pointer_v<T> && std::is_class_v<std::remove_pointer_t<T>>))
+            {
+                using traits = js_traits<std::shared_ptr<std::remove_cv_t<typename std::pointer_traits<T>::element_type>>>;
+                if (JS_IsNull(val))
+                    return true;
+                JSClassID class_id = JS_GetClassID(val);
+                return JS_IsObject(val) && (class_id == traits::qjs_class_id || traits::ptr_cast_fcn_map.contains(class_id));
+            }
+            else if constexpr (is_specialization_of_v<T, std::function>)
+            {
+                return JS_IsFunction(ctx, val);
+            }
+            else if constexpr (is_specialization_of_v<T, std::pair>)
+            {
+                return JS_IsArray(val);
+            }
+            else if constexpr (std::ranges::input_range<T>)
+            {
+                if constexpr (is_specialization_of_v<std::ranges::range_value_t<T>, std::pair>)
+                    return JS_IsObject(val);
+                else
+                    return JS_IsArray(val);
+            }
+            else
+            {
+                return true;
+            }
+        }
+
+        /** Describes the JS arguments accepted by a callable wrapped with wrap_call<PassThis>. */
+        template<bool PassThis, typename Function>
+        struct call_signature
+        {
+            using args = typename function_traits<Function>::args;
+            static constexpr bool is_member = std::is_member_function_pointer_v<std::remove_reference_t<Function>>;
+
+            /// Leading parameters filled from JS "this" rather than the arguments.
+            static constexpr std::size_t this_params = (!is_member && PassThis) ? 1 : 0;
+            /// JS arguments consumed by the owning object of a member function called without "this".
+            static constexpr std::size_t owner_args = (is_member && !PassThis) ? 1 : 0;
+            static constexpr std::size_t params = std::tuple_size_v<args> - this_params;
+
+            static constexpr bool variadic = []() {
+                if constexpr (params == 0)
+                    return false;
+                else
+                    return is_specialization_of_v<std::decay_t<std::tuple_element_t<std::tuple_size_v<args> - 1, args>>, rest>;
+            }();
+
+            static constexpr std::size_t min_argc = owner_args + params - (variadic ? 1 : 0);
+            static constexpr std::size_t max_argc = variadic ? SIZE_MAX : owner_args + params;
+
+            /** Whether the types of the JS arguments that are present match the parameters. */
+            static bool matches(JSContext* ctx, int argc, JSValueConst* argv)
+            {
+                if constexpr (owner_args)
+                {
+                    using Owner = typename function_traits<Function>::owner_type;
+                    if (argc < 1 || !matches_js_type<Owner>(ctx, argv[0]))
+                        return false;
+                }
+
+                return [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+                    return (matches_param<Is>(ctx, argc, argv) && ...);
+                }(std::make_index_sequence<params>());
+            }
+        private:
+            template<std::size_t I>
+            static bool matches_param(JSContext* ctx, int argc, JSValueConst* argv)
+            {
+                using Param = std::decay_t<std::tuple_element_t<I + this_params, args>>;
+                constexpr std::size_t arg = I + owner_args;
+                if constexpr (is_specialization_of_v<Param, rest>)
+                {
+                    for (int i = arg; i < argc; ++i)
+                        if (!matches_js_type<typename Param::value_type>(ctx, argv[i]))
+                            return false;
+                    return true;
+                }
+                else
+                {
+                    return static_cast<int>(arg) >= argc || matches_js_type<Param>(ctx, argv[arg]);
+                }
+            }
+        };
+
+        /** Picks the overload to call for the given JS arguments.
+         *  Prefers the first overload taking exactly as many arguments as given, then the first one that can ignore
+         *  extra arguments. Argument types are compared with matches_js_type.
+         *  @tparam Functions Callables or function types, in order of preference.
+         *  @return Index into Functions, or -1 if no overload matches.
+         */
+        template<bool PassThis, typename... Functions>
+        int select_overload(JSContext* ctx, int argc, JSValueConst* argv)
+        {
+            const std::size_t nargs = argc;
+            auto find = [&](bool allow_extra_args) {
+                int index = 0;
+                bool found = ((
+                    (nargs >= call_signature<PassThis, Functions>::min_argc &&
+                     (nargs <= call_signature<PassThis, Functions>::max_argc || allow_extra_args) &&
+                     call_signature<PassThis, Functions>::matches(ctx, argc, argv)) || (++index, false)) || ...);
+                return found ? index : -1;
+            };
+
+            int index = find(false);
+            return index >= 0 ? index : find(true);
+        }
+
+        /** Calls the overload at `index` of a tuple of callables, with wrap_call semantics. */
+        template<bool PassThis, typename... Functions>
+        JSValue wrap_overload_call(JSContext* ctx, int index, std::tuple<Functions...>& functions,
+                                   JSValueConst this_val, int argc, JSValueConst* argv, int binding = 0)
+        {
+            JSValue result = JS_UNDEFINED;
+            [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+                ((index == static_cast<int>(Is) &&
+                  (result = wrap_call<PassThis>(ctx, std::get<Is>(functions), this_val, argc, argv, binding), true)) || ...);
+            }(std::index_sequence_for<Functions...>());
+            return result;
+        }
+
         template <typename... Args>
         void wrap_args(JSContext* ctx, JSValue* argv, Args&&... args)
         {
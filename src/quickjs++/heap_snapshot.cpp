@@ -0,0 +1,421 @@
+#include "heap_snapshot.h"
+#include "internal.h"
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace qjs
+{
+    namespace
+    {
+        // indices into the node_types and edge_types of the snapshot's meta section
+        enum node_type { node_object = 3, node_closure = 5, node_native = 8, node_synthetic = 9,
+                         node_string = 2, node_symbol = 12, node_bigint = 13 };
+        enum edge_type { edge_element = 1, edge_property = 2, edge_internal = 3, edge_shortcut = 5 };
+
+        // rough costs of engine structures, for self sizes
+        constexpr std::size_t object_size = 64;
+        constexpr std::size_t property_size = 16;
+        constexpr std::size_t string_header_size = 16;
+
+        constexpr std::size_t max_name_length = 256;
+        constexpr std::size_t node_field_count = 6;
+
+        struct node
+        {
+            int type;
+            std::size_t name;
+            uint64_t id;
+            std::size_t self_size;
+            std::size_t edge_count;
+        };
+
+        struct edge
+        {
+            int type;
+            std::size_t name_or_index;
+            std::size_t to;
+        };
+
+        /** Odd ids, like V8's for heap objects, stable for as long as the object lives at the same address. */
+        uint64_t id_of(const void* ptr)
+        {
+            return (reinterpret_cast<uintptr_t>(ptr) >> 2) * 2 + 1;
+        }
+
+        /** Class id of proxies, taken from one made with the Proxy constructor. */
+        JSClassID proxy_class(JSContext* ctx)
+        {
+            return detail::builtin_class_id(ctx, [](JSContext* fresh) {
+                JSValue global = JS_GetGlobalObject(fresh);
+                JSValue constructor = JS_GetPropertyStr(fresh, global, "Proxy");
+                JSValue args[] = { JS_NewObject(fresh), JS_NewObject(fresh) };
+                JSValue proxy = JS_CallConstructor(fresh, constructor, 2, args);
+                for (JSValue v : { args[0], args[1], constructor, global })
+                    JS_FreeValue(fresh, v);
+                return proxy;
+            });
+        }
+
+        /** Builds the graph breadth-first. Nodes are processed in the order they were created, which keeps
+         *  the edges of each node contiguous and in node order, as the format requires.
+         */
+        class snapshot_builder
+        {
+        public:
+            explicit snapshot_builder(JSContext* ctx)
+                : m_ctx(ctx),
+                  m_proxy_class(proxy_class(ctx)),
+                  m_name_atom(JS_NewAtom(ctx, "name")),
+                  m_constructor_atom(JS_NewAtom(ctx, "constructor"))
+            {
+                m_strings.emplace_back();
+                m_string_ids.emplace("", 0);
+                add_node(node_synthetic, "(root)", 1, 0, JS_UNDEFINED);
+            }
+
+            snapshot_builder(const snapshot_builder&) = delete;
+
+            ~snapshot_builder()
+            {
+                for (JSValue& val : m_pending)
+                    JS_FreeValue(m_ctx, val);
+                JS_FreeAtom(m_ctx, m_name_atom);
+                JS_FreeAtom(m_ctx, m_constructor_atom);
+            }
+
+            void add_root(const char* name, JSValueConst val)
+            {
+                add_edge(edge_shortcut, name, val);
+                m_nodes[0].edge_count = m_edges.size();
+            }
+
+            void build()
+            {
+                for (std::size_t index = 1; index < m_nodes.size(); ++index)
+                {
+                    std::size_t first_edge = m_edges.size();
+                    JSValue val = std::exchange(m_pending[index], JS_UNDEFINED);
+                    if (m_nodes[index].type == node_native)
+                        add_native_edges(index);
+                    else if (JS_IsObject(val))
+                        add_object_edges(index, val);
+                    JS_FreeValue(m_ctx, val);
+                    m_nodes[index].edge_count = m_edges.size() - first_edge;
+                }
+            }
+
+            void write(std::ostream& out) const
+            {
+                out << R"({"snapshot":{"meta":{"node_fields":["type","name","id","self_size","edge_count","trace_node_id"],)"
+                       R"("node_types":[["hidden","array","string","object","code","closure","regexp","number","native",)"
+                       R"("synthetic","concatenated string","sliced string","symbol","bigint"],"string","number","number","number","number"],)"
+                       R"("edge_fields":["type","name_or_index","to_node"],)"
+                       R"("edge_types":[["context","element","property","internal","hidden","shortcut","weak"],"string_or_number","node"],)"
+                       R"("trace_function_info_fields":["function_id","name","script_name","script_id","line","column"],)"
+                       R"("trace_node_fields":["id","function_info_index","count","size","children"],)"
+                       R"("sample_fields":["timestamp_us","last_assigned_id"],)"
+                       R"("location_fields":["object_index","script_id","line","column"]},)";
+                out << "\"node_count\":" << m_nodes.size() << ",\"edge_count\":" << m_edges.size()
+                    << ",\"trace_function_count\":0},\n\"nodes\":[";
+
+                for (std::size_t i = 0; i < m_nodes.size(); ++i)
+                {
+                    const node& n = m_nodes[i];
+                    out << (i ? ",\n" : "") << n.type << ',' << n.name << ',' << n.id << ',' << n.self_size << ','
+                        << n.edge_count << ",0";
+                }
+
+                out << "],\n\"edges\":[";
+                for (std::size_t i = 0; i < m_edges.size(); ++i)
+                {
+                    const edge& e = m_edges[i];
+                    // to_node is the offset of the node in the flat nodes array
+                    out << (i ? ",\n" : "") << e.type << ',' << e.name_or_index << ',' << e.to * node_field_count;
+                }
+
+                out << "],\n\"trace_function_infos\":[],\"trace_tree\":[],\"samples\":[],\"locations\":[],\n\"strings\":[";
+                for (std::size_t i = 0; i < m_strings.size(); ++i)
+                {
+                    out << (i ? ",\n" : "");
+                    detail::write_json_string(out, m_strings[i]);
+                }
+                out << "]}";
+            }
+        private:
+            JSContext* m_ctx;
+            JSClassID m_proxy_class;
+            JSAtom m_name_atom;
+            JSAtom m_constructor_atom;
+            std::vector<node> m_nodes;
+            std::vector<JSValue> m_pending; // values of nodes left to process, by node index
+            std::vector<edge> m_edges;
+            std::vector<std::string> m_strings;
+            std::unordered_map<std::string, std::size_t> m_string_ids;
+            std::unordered_map<const void*, std::size_t> m_node_ids; // engine or C++ object -> node index
+            std::unordered_map<std::size_t, std::pair<const detail::class_info*, void*>> m_natives; // node index -> class, opaque
+            std::unordered_map<const void*, std::string> m_constructor_names; // prototype -> name
+
+            std::size_t string_id(std::string_view str)
+            {
+                if (str.size() > max_name_length)
+                    str = str.substr(0, max_name_length);
+
+                auto [it, inserted] = m_string_ids.try_emplace(std::string(str), m_strings.size());
+                if (inserted)
+                    m_strings.emplace_back(str);
+                return it->second;
+            }
+
+            std::size_t add_node(int type, std::string_view name, uint64_t id, std::size_t self_size, JSValue pending)
+            {
+                m_nodes.push_back({ type, string_id(name), id, self_size, 0 });
+                m_pending.push_back(pending);
+                return m_nodes.size() - 1;
+            }
+
+            std::string to_string(JSValueConst val)
+            {
+                std::size_t length;
+                const char* str = JS_ToCStringLen(m_ctx, &length, val);
+                if (!str)
+                {
+                    JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                    return {};
+                }
+                std::string result(str, std::min(length, max_name_length));
+                JS_FreeCString(m_ctx, str);
+                return result;
+            }
+
+            std::string atom_name(JSAtom atom)
+            {
+                const char* str = JS_AtomToCString(m_ctx, atom);
+                if (!str)
+                {
+                    JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                    return {};
+                }
+                std::string result(str);
+                JS_FreeCString(m_ctx, str);
+                return result;
+            }
+
+            /** Own data property of an object, or JS_UNDEFINED. Never runs getters. */
+            JSValue data_property(JSValueConst obj, JSAtom prop)
+            {
+                JSPropertyDescriptor desc;
+                int found = JS_GetOwnProperty(m_ctx, &desc, obj, prop);
+                if (found < 0)
+                    JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                if (found <= 0)
+                    return JS_UNDEFINED;
+
+                JS_FreeValue(m_ctx, desc.getter);
+                JS_FreeValue(m_ctx, desc.setter);
+                return desc.value;
+            }
+
+            std::string function_name(JSValueConst func)
+            {
+                JSValue name = data_property(func, m_name_atom);
+                std::string result = JS_IsString(name) ? to_string(name) : std::string();
+                JS_FreeValue(m_ctx, name);
+                return result.empty() ? "(anonymous)" : result;
+            }
+
+            /** Name of the constructor of the prototype, like DevTools' class names. */
+            std::string constructor_name(JSValueConst proto)
+            {
+                if (!JS_IsObject(proto))
+                    return "Object";
+
+                const void* key = JS_VALUE_GET_PTR(proto);
+                if (auto it = m_constructor_names.find(key); it != m_constructor_names.end())
+                    return it->second;
+
+                std::string result = "Object";
+                if (JS_GetClassID(proto) != m_proxy_class)
+                {
+                    JSValue ctor = data_property(proto, m_constructor_atom);
+                    if (JS_IsFunction(m_ctx, ctor))
+                        result = function_name(ctor);
+                    JS_FreeValue(m_ctx, ctor);
+                }
+                return m_constructor_names[key] = result;
+            }
+
+            /** Node of a value, created if needed, or nullopt for values without a node (numbers, booleans...). */
+            std::optional<std::size_t> node_of(JSValueConst val)
+            {
+                int tag = JS_VALUE_GET_TAG(val);
+                if (tag != JS_TAG_OBJECT && !JS_IsString(val) && tag != JS_TAG_SYMBOL && tag != JS_TAG_BIG_INT)
+                    return std::nullopt;
+
+                const void* ptr = JS_VALUE_GET_PTR(val);
+                if (auto it = m_node_ids.find(ptr); it != m_node_ids.end())
+                    return it->second;
+
+                std::size_t index;
+                if (JS_IsString(val))
+                {
+                    std::string str = to_string(val);
+                    index = add_node(node_string, str, id_of(ptr), string_header_size + str.size(), JS_UNDEFINED);
+                }
+                else if (tag == JS_TAG_SYMBOL)
+                {
+                    index = add_node(node_symbol, "symbol", id_of(ptr), string_header_size, JS_UNDEFINED);
+                }
+                else if (tag == JS_TAG_BIG_INT)
+                {
+                    index = add_node(node_bigint, "bigint", id_of(ptr), string_header_size, JS_UNDEFINED);
+                }
+                else
+                {
+                    // type, name and size are filled in when the object is processed
+                    index = add_node(node_object, "", id_of(ptr), object_size, JS_DupValue(m_ctx, val));
+                }
+
+                m_node_ids.emplace(ptr, index);
+                return index;
+            }
+
+            void add_edge(int type, std::string_view name, JSValueConst to)
+            {
+                if (auto index = node_of(to))
+                    m_edges.push_back({ type, string_id(name), *index });
+            }
+
+            void add_element_edge(uint32_t element, JSValueConst to)
+            {
+                if (auto index = node_of(to))
+                    m_edges.push_back({ edge_element, element, *index });
+            }
+
+            void add_object_edges(std::size_t index, JSValueConst obj)
+            {
+                JSClassID class_id = JS_GetClassID(obj);
+                if (class_id == m_proxy_class) // its traps could run JS
+                {
+                    m_nodes[index].name = string_id("Proxy");
+                    return;
+                }
+
+                JSPropertyEnum* props;
+                uint32_t length;
+                if (JS_GetOwnPropertyNames(m_ctx, &props, &length, obj, JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK) < 0)
+                {
+                    JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                    length = 0;
+                    props = nullptr;
+                }
+
+                for (uint32_t i = 0; i < length; ++i)
+                {
+                    JSPropertyDescriptor desc;
+                    int found = JS_GetOwnProperty(m_ctx, &desc, obj, props[i].atom);
+                    if (found < 0)
+                        JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                    if (found <= 0)
+                        continue;
+
+                    if (desc.flags & JS_PROP_GETSET)
+                    {
+                        std::string name = atom_name(props[i].atom);
+                        add_edge(edge_internal, "get " + name, desc.getter);
+                        add_edge(edge_internal, "set " + name, desc.setter);
+                    }
+                    else
+                    {
+                        JSValue key = JS_AtomToValue(m_ctx, props[i].atom);
+                        if (JS_VALUE_GET_TAG(key) == JS_TAG_INT && JS_VALUE_GET_INT(key) >= 0)
+                            add_element_edge(static_cast<uint32_t>(JS_VALUE_GET_INT(key)), desc.value);
+                        else
+                            add_edge(edge_property, atom_name(props[i].atom), desc.value);
+                        JS_FreeValue(m_ctx, key);
+                    }
+
+                    JS_FreeValue(m_ctx, desc.value);
+                    JS_FreeValue(m_ctx, desc.getter);
+                    JS_FreeValue(m_ctx, desc.setter);
+                }
+                JS_FreePropertyEnum(m_ctx, props, length);
+
+                std::size_t self_size = object_size + length * property_size;
+                if (JS_IsArrayBuffer(obj))
+                {
+                    std::size_t size = 0;
+                    if (!JS_GetArrayBuffer(m_ctx, &size, obj))
+                        JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                    self_size += size;
+                }
+
+                JSValue proto = JS_GetPrototype(m_ctx, obj);
+                if (JS_IsException(proto))
+                {
+                    JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                    proto = JS_NULL;
+                }
+                add_edge(edge_internal, "__proto__", proto);
+
+                node& n = m_nodes[index];
+                n.self_size = self_size;
+                if (const detail::class_info* info = detail::find_class_info(class_id))
+                {
+                    n.name = string_id(info->name);
+                    if (void* opaque = JS_GetOpaque(obj, class_id))
+                        add_native_node(info, opaque);
+                }
+                else if (JS_IsFunction(m_ctx, obj))
+                {
+                    n.type = node_closure;
+                    n.name = string_id(function_name(obj));
+                }
+                else if (JS_IsArray(obj))
+                {
+                    n.name = string_id("Array");
+                }
+                else
+                {
+                    n.name = string_id(constructor_name(proto));
+                }
+                JS_FreeValue(m_ctx, proto);
+            }
+
+            /** Adds an edge to the node of the C++ object held by an object of a registered class. */
+            void add_native_node(const detail::class_info* info, void* opaque)
+            {
+                const void* object = info->object(opaque);
+                auto [it, inserted] = m_node_ids.try_emplace(object, m_nodes.size());
+                if (inserted)
+                {
+                    add_node(node_native, info->name + " (C++)", id_of(object), info->size, JS_UNDEFINED);
+                    m_natives.emplace(it->second, std::pair(info, opaque));
+                }
+                m_edges.push_back({ edge_internal, string_id("native"), it->second });
+            }
+
+            /** Adds edges to the values a C++ object marks for the GC. */
+            void add_native_edges(std::size_t index)
+            {
+                auto [info, opaque] = m_natives.at(index);
+                info->for_each_marked(opaque, [](JSValueConst val, void* self) {
+                    static_cast<snapshot_builder*>(self)->add_edge(edge_internal, "value", val);
+                }, this);
+            }
+        };
+    }
+
+    void write_heap_snapshot(context& context, std::ostream& out, const std::vector<value>& roots)
+    {
+        snapshot_builder builder(context.ctx);
+
+        value global = context.global();
+        builder.add_root("globalThis", global.v);
+        for (std::size_t i = 0; i < roots.size(); ++i)
+            builder.add_root(("root " + std::to_string(i)).c_str(), roots[i].v);
+
+        builder.build();
+        builder.write(out);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "context.h"
+#include <ostream>
+#include <vector>
+
+namespace qjs
+{
+    /** Writes the objects reachable from a context's global object, and from `roots`, as a V8 heap snapshot
+     *  (.heapsnapshot), which Chrome DevTools' Memory panel and other V8 snapshot viewers can load.
+     *  Node ids are derived from object addresses, so two snapshots of the same context can be compared
+     *  to see which objects were added between them.
+     *
+     *  The graph is found through the public engine API without running the context's scripts: own properties
+     *  (data values, getters and setters), prototypes, and qjs::value members of registered C++ classes marked
+     *  with class_registrar::mark, which appear under a native node for the C++ object. References the API
+     *  doesn't expose, like closure variables, Map/Set entries and typed array buffers, are missing, and
+     *  proxies are leaves. Sizes are estimates, not the engine's exact allocation sizes.
+     *  @param roots Additional values to report as GC roots, e.g. values held by C++ code.
+     *  @throws exception
+     */
+    void write_heap_snapshot(context& context, std::ostream& out, const std::vector<value>& roots = {});
+}
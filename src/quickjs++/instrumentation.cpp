@@ -0,0 +1,160 @@
+#include "instrumentation.h"
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace qjs
+{
+    namespace
+    {
+        // stats live in fixed-size chunks that are never freed, so lookups by id need no lock;
+        // ids travel as the int16_t magic of C functions, so there are at most INT16_MAX of them
+        constexpr std::size_t chunk_size = 256;
+        constexpr std::size_t max_chunks = (static_cast<std::size_t>(INT16_MAX) + 1) / chunk_size;
+
+        struct registry
+        {
+            std::atomic<bool> enabled { false };
+            std::array<std::atomic<detail::binding_stats*>, max_chunks> chunks {};
+
+            std::mutex mutex;
+            std::unordered_map<std::string, int> ids;
+            std::vector<std::string> names { "" }; // id 0 means untracked
+        };
+
+        registry& get_registry()
+        {
+            static registry* instance = new registry; // leaked, so bindings can be called during static destruction
+            return *instance;
+        }
+
+        detail::binding_stats* lookup(registry& r, int id) noexcept
+        {
+            std::size_t index = static_cast<std::size_t>(id);
+            if (id < 0 || index >= chunk_size * max_chunks)
+                return nullptr;
+            detail::binding_stats* chunk = r.chunks[index / chunk_size].load(std::memory_order_acquire);
+            return chunk ? &chunk[index % chunk_size] : nullptr;
+        }
+    }
+
+    namespace instrumentation
+    {
+        void enable(bool enabled) noexcept
+        {
+            get_registry().enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        bool enabled() noexcept
+        {
+            return get_registry().enabled.load(std::memory_order_relaxed);
+        }
+
+        std::vector<binding_snapshot> snapshot()
+        {
+            registry& r = get_registry();
+            std::lock_guard lock(r.mutex);
+
+            std::vector<binding_snapshot> result;
+            for (std::size_t id = 1; id < r.names.size(); ++id)
+            {
+                detail::binding_stats& stats = *lookup(r, static_cast<int>(id));
+                uint64_t calls = stats.calls.load(std::memory_order_relaxed);
+                if (!calls)
+                    continue;
+
+                binding_snapshot& snap = result.emplace_back(binding_snapshot {
+                    .name = r.names[id],
+                    .calls = calls,
+                    .exceptions = stats.exceptions.load(std::memory_order_relaxed),
+                    .conversion_time = std::chrono::nanoseconds(stats.conversion_ns.load(std::memory_order_relaxed)),
+                    .native_time = std::chrono::nanoseconds(stats.native_ns.load(std::memory_order_relaxed)),
+                    .latency_histogram = {}
+                });
+                for (std::size_t i = 0; i < histogram_buckets; ++i)
+                    snap.latency_histogram[i] = stats.histogram[i].load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+
+        void reset() noexcept
+        {
+            registry& r = get_registry();
+            std::lock_guard lock(r.mutex);
+            for (std::size_t id = 1; id < r.names.size(); ++id)
+            {
+                detail::binding_stats& stats = *lookup(r, static_cast<int>(id));
+                stats.calls = 0;
+                stats.exceptions = 0;
+                stats.conversion_ns = 0;
+                stats.native_ns = 0;
+                for (auto& bucket : stats.histogram)
+                    bucket = 0;
+            }
+        }
+    }
+
+    namespace detail
+    {
+        int binding_id(const char* name)
+        {
+            registry& r = get_registry();
+            if (!name || !r.enabled.load(std::memory_order_relaxed))
+                return 0;
+
+            std::lock_guard lock(r.mutex);
+            if (auto it = r.ids.find(name); it != r.ids.end())
+                return it->second;
+
+            std::size_t id = r.names.size();
+            if (id >= chunk_size * max_chunks)
+                return 0;
+            if (!r.chunks[id / chunk_size].load(std::memory_order_relaxed))
+                r.chunks[id / chunk_size].store(new binding_stats[chunk_size], std::memory_order_release);
+
+            r.names.emplace_back(name);
+            r.ids.emplace(name, static_cast<int>(id));
+            return static_cast<int>(id);
+        }
+
+        std::string binding_name(int id)
+        {
+            registry& r = get_registry();
+            std::lock_guard lock(r.mutex);
+            std::size_t index = static_cast<std::size_t>(id);
+            return index < r.names.size() ? r.names[index] : std::string();
+        }
+
+        binding_stats* binding_stats_for(int id) noexcept
+        {
+            registry& r = get_registry();
+            if (!r.enabled.load(std::memory_order_relaxed))
+                return nullptr;
+            return lookup(r, id);
+        }
+
+        call_timer::~call_timer()
+        {
+            if (!m_stats)
+                return;
+
+            clock::time_point end = clock::now();
+            if (m_returned < m_converted) // the native function threw
+                m_returned = end;
+
+            auto ns = [](clock::duration d) { return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()); };
+            uint64_t total = ns(end - m_start);
+
+            m_stats->calls.fetch_add(1, std::memory_order_relaxed);
+            if (m_failed)
+                m_stats->exceptions.fetch_add(1, std::memory_order_relaxed);
+            m_stats->conversion_ns.fetch_add(ns(m_converted - m_start) + ns(end - m_returned), std::memory_order_relaxed);
+            m_stats->native_ns.fetch_add(ns(m_returned - m_converted), std::memory_order_relaxed);
+
+            std::size_t bucket = total ? static_cast<std::size_t>(std::bit_width(total) - 1) : 0;
+            m_stats->histogram[std::min(bucket, instrumentation::histogram_buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace qjs
+{
+    /** Opt-in statistics of calls into native bindings, keyed by binding name (fwrapper::name, constructor name).
+     *  Only bindings created while instrumentation is enabled are tracked, so enable it before bindings
+     *  are added to contexts. Disabling pauses recording. Calls of untracked bindings cost one branch.
+     */
+    namespace instrumentation
+    {
+        /// Number of latency histogram buckets; bucket i counts calls that took [2^i, 2^(i+1)) ns.
+        constexpr std::size_t histogram_buckets = 32;
+
+        /** Statistics of one binding at the time of a snapshot. */
+        struct binding_snapshot
+        {
+            std::string name;
+            uint64_t calls;
+            uint64_t exceptions;
+            /// Time spent converting arguments from and the result to JS.
+            std::chrono::nanoseconds conversion_time;
+            /// Time spent in the native function itself.
+            std::chrono::nanoseconds native_time;
+            std::array<uint64_t, histogram_buckets> latency_histogram;
+        };
+
+        void enable(bool enabled = true) noexcept;
+        bool enabled() noexcept;
+
+        /** Statistics of all tracked bindings that were called at least once. */
+        std::vector<binding_snapshot> snapshot();
+
+        /** Zero the statistics of all tracked bindings. */
+        void reset() noexcept;
+    }
+
+    namespace detail
+    {
+        struct binding_stats
+        {
+            std::atomic<uint64_t> calls { 0 };
+            std::atomic<uint64_t> exceptions { 0 };
+            std::atomic<uint64_t> conversion_ns { 0 };
+            std::atomic<uint64_t> native_ns { 0 };
+            std::array<std::atomic<uint64_t>, instrumentation::histogram_buckets> histogram {};
+        };
+
+        /** Id to pass as the magic of a binding's function, or 0 if the binding shouldn't be tracked.
+         *  Ids fit the int16_t magic: bindings beyond the first INT16_MAX names are not tracked.
+         */
+        int binding_id(const char* name);
+
+        /** Name of a binding id, or an empty string for id 0. */
+        std::string binding_name(int id);
+
+        /** Statistics of a binding id, or nullptr if it is untracked or instrumentation is disabled. Lock-free. */
+        binding_stats* binding_stats_for(int id) noexcept;
+
+        /** Measures one call of a binding and records it on destruction.
+         *  Time before converted() counts as conversion, between converted() and returned() as native,
+         *  and after returned() as conversion again. Does nothing for untracked bindings.
+         */
+        class call_timer
+        {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            explicit call_timer(int binding) noexcept : m_stats(binding ? binding_stats_for(binding) : nullptr)
+            {
+                if (m_stats)
+                    m_start = m_converted = m_returned = clock::now();
+            }
+
+            call_timer(const call_timer&) = delete;
+
+            ~call_timer();
+
+            void converted() noexcept
+            {
+                if (m_stats)
+                    m_converted = clock::now();
+            }
+
+            void returned() noexcept
+            {
+                if (m_stats)
+                    m_returned = clock::now();
+            }
+
+            void failed() noexcept { m_failed = true; }
+        private:
+            binding_stats* m_stats;
+            clock::time_point m_start, m_converted, m_returned;
+            bool m_failed = false;
+        };
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "exception.h"
+#include <quickjs/quickjs.h>
+#include <ostream>
+#include <string_view>
+
+/** Helpers shared by the library's translation units. Not part of the public API. */
+namespace qjs::detail
+{
+    /** Writes `str` as a quoted JSON string, escaping quotes, backslashes and control characters. */
+    inline void write_json_string(std::ostream& out, std::string_view str)
+    {
+        out << '"';
+        for (char c : str)
+        {
+            switch (c)
+            {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    const char* hex = "0123456789abcdef";
+                    out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+                }
+                else
+                {
+                    out << c;
+                }
+            }
+        }
+        out << '"';
+    }
+
+    /** Class id of a built-in class, for classes whose ids aren't public.
+     *  Taken from the object `make(fresh)` returns, where `fresh` is a new context of ctx's runtime that no script
+     *  can have reached. Built-in class ids are the same in every runtime, so the id is looked up once per process
+     *  for each `make`, which must be a lambda so that every call site has its own.
+     *  @throws exception in ctx if the object can't be made.
+     */
+    template<typename F>
+    JSClassID builtin_class_id(JSContext* ctx, F make)
+    {
+        static const JSClassID class_id = [ctx, &make] {
+            JSContext* fresh = JS_NewContext(JS_GetRuntime(ctx));
+            if (!fresh)
+            {
+                JS_ThrowOutOfMemory(ctx);
+                throw exception(ctx);
+            }
+
+            JSValue obj = make(fresh);
+            JSClassID result = JS_IsObject(obj) ? JS_GetClassID(obj) : 0;
+            if (JS_IsException(obj))
+                JS_FreeValue(fresh, JS_GetException(fresh));
+            JS_FreeValue(fresh, obj);
+            JS_FreeContext(fresh);
+
+            if (!result)
+            {
+                JS_ThrowInternalError(ctx, "Cannot determine the class id of a built-in class");
+                throw exception(ctx);
+            }
+            return result;
+        }();
+        return class_id;
+    }
+}
@@ -1,8 +1,116 @@
 #include "js_traits.h"
+#include "unicode.h"
 #include "value.h"
+#include <mutex>
 
 namespace qjs
 {
+    namespace detail
+    {
+        namespace
+        {
+            // entries are never removed, so pointers to them stay valid
+            std::mutex class_infos_mutex;
+            std::unordered_map<JSClassID, std::unique_ptr<class_info>> class_infos;
+        }
+
+        void register_class_info(JSClassID class_id, class_info info)
+        {
+            std::lock_guard lock(class_infos_mutex);
+            auto& entry = class_infos[class_id];
+            if (!entry)
+                entry = std::make_unique<class_info>(std::move(info));
+        }
+
+        const class_info* find_class_info(JSClassID class_id)
+        {
+            std::lock_guard lock(class_infos_mutex);
+            auto it = class_infos.find(class_id);
+            return it != class_infos.end() ? it->second.get() : nullptr;
+        }
+
+        std::u16string unwrap_utf16(JSContext* ctx, JSValueConst val)
+        {
+            // CESU-8 encodes each UTF-16 code unit on its own, surrogates included, so it maps back one to one
+            std::size_t length;
+            const char* data = JS_ToCStringLen2(ctx, &length, val, true);
+            if (!data)
+                throw exception(ctx);
+
+            auto bytes = reinterpret_cast<const unsigned char*>(data);
+            std::u16string result;
+            result.resize(length); // there are at most as many code units as bytes
+            std::size_t out = 0;
+            for (std::size_t i = 0; i < length;)
+            {
+                unsigned char c = bytes[i];
+                if (c < 0x80)
+                {
+                    // widen the whole ASCII run at once
+                    std::size_t run = unicode::ascii_length(std::string_view(data + i, length - i));
+                    unicode::widen(std::string_view(data + i, run), result.data() + out);
+                    out += run;
+                    i += run;
+                }
+                else if (c < 0xe0 && i + 1 < length)
+                {
+                    result[out++] = static_cast<char16_t>(((c & 0x1f) << 6) | (bytes[i + 1] & 0x3f));
+                    i += 2;
+                }
+                else if (c < 0xf0 && i + 2 < length)
+                {
+                    result[out++] = static_cast<char16_t>(((c & 0x0f) << 12) | ((bytes[i + 1] & 0x3f) << 6) | (bytes[i + 2] & 0x3f));
+                    i += 3;
+                }
+                else if (i + 3 < length) // 4-byte UTF-8, should the engine produce any
+                {
+                    char32_t cp = ((c & 0x07) << 18) | ((bytes[i + 1] & 0x3f) << 12) | ((bytes[i + 2] & 0x3f) << 6) | (bytes[i + 3] & 0x3f);
+                    cp -= 0x10000;
+                    result[out++] = static_cast<char16_t>(0xd800 + (cp >> 10));
+                    result[out++] = static_cast<char16_t>(0xdc00 + (cp & 0x3ff));
+                    i += 4;
+                }
+                else // truncated sequence
+                {
+                    result[out++] = u'\ufffd';
+                    break;
+                }
+            }
+            JS_FreeCString(ctx, data);
+
+            result.resize(out);
+            return result;
+        }
+
+        JSValue new_string_utf16(JSContext* ctx, std::u16string_view str) noexcept
+        {
+            if (unicode::is_ascii(str))
+            {
+                // ASCII text is stored as an 8-bit string, narrowed on the stack when short
+                char buffer[string_cache::max_length];
+                if (str.size() <= sizeof(buffer))
+                {
+                    unicode::narrow(str, buffer);
+                    return new_string(ctx, std::string_view(buffer, str.size()));
+                }
+
+                try
+                {
+                    std::string narrow(str.size(), '\0');
+                    unicode::narrow(str, narrow.data());
+                    return JS_NewStringLen(ctx, narrow.data(), narrow.size());
+                }
+                catch (const std::bad_alloc&)
+                {
+                    return JS_ThrowOutOfMemory(ctx);
+                }
+            }
+
+            static_assert(sizeof(char16_t) == sizeof(uint16_t));
+            return JS_NewTwoByteString(ctx, reinterpret_cast<const uint16_t*>(str.data()), str.size());
+        }
+    }
+
     value js_traits<value>::unwrap(JSContext* ctx, JSValueConst val)
     {
         return value(ctx, JS_DupValue(ctx, val));
@@ -1,8 +1,11 @@
 #pragma once
 #include "function_wrapping.h"
+#include "string_cache.h"
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <ranges>
+#include <string>
 #include <unordered_map>
 #include <utility>
 
@@ -29,6 +32,31 @@ namespace qjs
             JSContext* m_ctx;
         };
 
+        /** Shares ownership of a JS value between copies of a callable; the value is freed with the last copy. */
+        inline std::shared_ptr<JSValue> share_value(JSContext* ctx, JSValueConst val)
+        {
+            return std::shared_ptr<JSValue>(new JSValue(JS_DupValue(ctx, val)), [ctx](JSValue* v) {
+                JS_FreeValue(ctx, *v);
+                delete v;
+            });
+        }
+
+        /** Description of a C++ class registered with js_traits<std::shared_ptr<T>>, for heap snapshots. */
+        struct class_info
+        {
+            std::string name;
+            std::size_t size;
+            /// Calls visit for each qjs::value member marked with class_registrar::mark, or nullptr if none.
+            void (*for_each_marked)(void* opaque, void (*visit)(JSValueConst val, void* data), void* data);
+            /// Returns the address of the C++ object held by an object's opaque pointer.
+            const void* (*object)(void* opaque);
+        };
+
+        void register_class_info(JSClassID class_id, class_info info);
+
+        /** Registered class of a class id, or nullptr if the class isn't a registered C++ class. */
+        const class_info* find_class_info(JSClassID class_id);
+
         template<typename Key, typename Value>
         std::unordered_map<Key, Value> get_properties(JSContext* ctx, JSValueConst v)
         {
@@ -138,7 +166,11 @@ namespace qjs
         }
     };
 
-    /** Conversion traits from std::string_view and to detail::jsstring_view. */
+    /** Conversion traits from std::string_view and to detail::jsstring_view.
+     *  Unwrapping a string of only ASCII characters borrows the string's own buffer, as QuickJS stores those
+     *  as valid UTF-8 already; other strings are converted to a UTF-8 copy. Short strings are wrapped through
+     *  the context's detail::string_cache.
+     */
     template<>
     struct js_traits<std::string_view>
     {
@@ -153,7 +185,7 @@ namespace qjs
 
         static JSValue wrap(JSContext* ctx, std::string_view val) noexcept
         {
-            return JS_NewStringLen(ctx, val.data(), val.size());
+            return detail::new_string(ctx, val);
         }
     };
 
@@ -171,7 +203,7 @@ namespace qjs
 
         static JSValue wrap(JSContext* ctx, const std::string& val) noexcept
         {
-            return JS_NewStringLen(ctx, val.c_str(), val.size());
+            return detail::new_string(ctx, val);
         }
     };
 
@@ -186,7 +218,48 @@ namespace qjs
 
         static JSValue wrap(JSContext* ctx, const char* val) noexcept
         {
-            return JS_NewString(ctx, val);
+            return detail::new_string(ctx, val);
+        }
+    };
+
+    namespace detail
+    {
+        /** Converts a JS value to UTF-16 code units, keeping unpaired surrogates. */
+        std::u16string unwrap_utf16(JSContext* ctx, JSValueConst val);
+
+        /** Creates a JS string from UTF-16 code units. ASCII-only text becomes an 8-bit string. */
+        JSValue new_string_utf16(JSContext* ctx, std::u16string_view str) noexcept;
+    }
+
+    /** Conversion traits for std::u16string_view, unwrapped to std::u16string.
+     *  Converts between JS strings and UTF-16 without going through UTF-8 on the C++ side.
+     */
+    template<>
+    struct js_traits<std::u16string_view>
+    {
+        static std::u16string unwrap(JSContext* ctx, JSValueConst val)
+        {
+            return detail::unwrap_utf16(ctx, val);
+        }
+
+        static JSValue wrap(JSContext* ctx, std::u16string_view val) noexcept
+        {
+            return detail::new_string_utf16(ctx, val);
+        }
+    };
+
+    /** Conversion traits for std::u16string. */
+    template<>
+    struct js_traits<std::u16string>
+    {
+        static std::u16string unwrap(JSContext* ctx, JSValueConst val)
+        {
+            return detail::unwrap_utf16(ctx, val);
+        }
+
+        static JSValue wrap(JSContext* ctx, const std::u16string& val) noexcept
+        {
+            return detail::new_string_utf16(ctx, val);
         }
     };
 
@@ -384,9 +457,9 @@ namespace qjs
 
             auto transform = [&](int64_t i) { return detail::unwrap_free<value_type>(ctx, JS_GetPropertyInt64(ctx, val, i)); };
         #ifdef __cpp_lib_ranges_to_container
-            return std::views::iota(0LL, length) | std::views::transform(transform) | std::ranges::to<Range>();
+            return std::views::iota(int64_t{0}, length) | std::views::transform(transform) | std::ranges::to<Range>();
         #else
-            auto range = std::views::iota(0LL, length) | std::views::transform(transform) | std::views::common;
+            auto range = std::views::iota(int64_t{0}, length) | std::views::transform(transform) | std::views::common;
             return Range(std::ranges::begin(range), std::ranges::end(range));
         #endif
         }
@@ -436,6 +509,142 @@ namespace qjs
         }
     };
 
+    namespace detail
+    {
+        /** State of a JS iterator over a range. The range is stored alongside its position. */
+        template<std::ranges::input_range Range>
+        struct range_iterator
+        {
+            Range range;
+            std::ranges::iterator_t<Range> it;
+
+            explicit range_iterator(Range&& range)
+                : range(std::move(range)), it(std::ranges::begin(this->range)) {}
+            range_iterator(const range_iterator&) = delete;
+        };
+
+        /** Creates an iterator result object { value, done }. */
+        inline JSValue new_iterator_result(JSContext* ctx, JSValue value, bool done)
+        {
+            static const JSAtom value_atom = JS_NewAtom(ctx, "value");
+            static const JSAtom done_atom = JS_NewAtom(ctx, "done");
+
+            JSValue result = JS_NewObject(ctx);
+            if (JS_IsException(result))
+            {
+                JS_FreeValue(ctx, value);
+                return result;
+            }
+
+            JS_DefinePropertyValue(ctx, result, value_atom, value, JS_PROP_C_W_E);
+            JS_DefinePropertyValue(ctx, result, done_atom, JS_NewBool(ctx, done), JS_PROP_C_W_E);
+            return result;
+        }
+
+        /** Creates an empty iterator object inheriting from %IteratorPrototype% where available. */
+        inline JSValue new_iterator_object(JSContext* ctx)
+        {
+            JSValue global = JS_GetGlobalObject(ctx);
+            JSValue iterator_ctor = JS_GetPropertyStr(ctx, global, "Iterator");
+            JS_FreeValue(ctx, global);
+
+            JSValue result;
+            if (JS_IsObject(iterator_ctor))
+            {
+                JSValue proto = get_property_prototype(ctx, iterator_ctor);
+                result = JS_NewObjectProto(ctx, proto);
+                JS_FreeValue(ctx, proto);
+            }
+            else
+            {
+                // no iterator helpers, so make the object iterable by hand
+                result = JS_NewObject(ctx);
+                JSValue return_this = JS_NewCFunction(ctx, [](JSContext* ctx, JSValueConst this_val, int, JSValueConst*) {
+                    return JS_DupValue(ctx, this_val);
+                }, "[Symbol.iterator]", 0);
+                JS_DefinePropertyValue(ctx, result, get_symbol_iterator(ctx), return_this,
+                                       JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE);
+            }
+
+            JS_FreeValue(ctx, iterator_ctor);
+            return result;
+        }
+    }
+
+    /** Conversion traits for iterable ranges -> JS iterators. */
+    template<std::ranges::input_range Range>
+    struct js_traits<iterable<Range>>
+    {
+        using value_type = std::ranges::range_value_t<Range>;
+
+        static iterable<Range> unwrap(JSContext* ctx, JSValueConst val)
+        {
+            JS_ThrowTypeError(ctx, "Can't unwrap iterable");
+            throw exception(ctx);
+        }
+
+        static JSValue wrap(JSContext* ctx, iterable<Range> val) noexcept
+        {
+            using state_type = detail::range_iterator<Range>;
+
+            JSValue result = detail::new_iterator_object(ctx);
+            if (JS_IsException(result))
+                return result;
+
+            JSCClosure* next = [](JSContext* ctx, JSValueConst, int, JSValueConst*, int, void* opaque) {
+                auto state = static_cast<state_type*>(opaque);
+                try
+                {
+                    if (!state || state->it == std::ranges::end(state->range))
+                        return detail::new_iterator_result(ctx, JS_UNDEFINED, true);
+
+                    JSValue value = js_traits<std::decay_t<value_type>>::wrap(ctx, *state->it);
+                    if (JS_IsException(value))
+                        return value;
+                    ++state->it;
+                    return detail::new_iterator_result(ctx, value, false);
+                }
+                catch (const exception&)
+                {
+                    return JS_EXCEPTION;
+                }
+                catch (const std::exception& ex)
+                {
+                    return JS_ThrowInternalError(ctx, "%s", ex.what());
+                }
+                catch (...)
+                {
+                    return JS_ThrowInternalError(ctx, "Unknown error");
+                }
+            };
+
+            JSCClosureFinalizerFunc* finalizer = [](void* p) {
+                delete static_cast<state_type*>(p);
+            };
+
+            state_type* state;
+            try
+            {
+                state = new state_type(std::move(val.range));
+            }
+            catch (...)
+            {
+                JS_FreeValue(ctx, result);
+                return JS_ThrowOutOfMemory(ctx);
+            }
+
+            JSValue next_func = JS_NewCClosure(ctx, next, "next", finalizer, 0, 0, state);
+            if (JS_IsException(next_func) || JS_DefinePropertyValueStr(ctx, result, "next", next_func,
+                                                                       JS_PROP_CONFIGURABLE | JS_PROP_WRITABLE) < 0)
+            {
+                JS_FreeValue(ctx, result);
+                return JS_EXCEPTION;
+            }
+
+            return result;
+        }
+    };
+
     /** Conversion traits for functions in fwrappers. */
     template<detail::any_invocable Function, bool PassThis>
     struct js_traits<fwrapper<Function, PassThis>>
@@ -450,9 +659,9 @@ namespace qjs
         {
             auto fptr = new std::decay_t<Function>(std::move(val.function));
 
-            JSCClosure* closure = [](JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv, int, void* opaque) {
+            JSCClosure* closure = [](JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv, int binding, void* opaque) {
                 if (auto function = static_cast<std::decay_t<Function>*>(opaque))
-                    return detail::wrap_call<PassThis>(ctx, *function, this_val, argc, argv);
+                    return detail::wrap_call<PassThis>(ctx, *function, this_val, argc, argv, binding);
                 return JS_NULL;
             };
 
@@ -460,7 +669,8 @@ namespace qjs
                 delete static_cast<std::decay_t<Function>*>(p);
             };
 
-            return JS_NewCClosure(ctx, closure, val.name, finalizer, function_traits<Function>::arity, 0, fptr);
+            return JS_NewCClosure(ctx, closure, val.name, finalizer, function_traits<Function>::arity,
+                                  detail::binding_id(val.name), fptr);
         }
     };
 
@@ -472,9 +682,9 @@ namespace qjs
         {
             if constexpr (sizeof...(Args) == 0)
             {
-                return [ctx, func_obj = JS_DupValue(ctx, val)]() -> R {
-                    JSValue result = JS_Call(ctx, func_obj, JS_UNDEFINED, 0, nullptr);
-                    JS_FreeValue(ctx, func_obj);
+                return [ctx, func_obj = detail::share_value(ctx, val)]() -> R {
+                    detail::allocation_scope allocations(ctx);
+                    JSValue result = JS_Call(ctx, *func_obj, JS_UNDEFINED, 0, nullptr);
                     if (JS_IsException(result))
                         throw exception(ctx);
                     return detail::unwrap_free<R>(ctx, result);
@@ -482,11 +692,11 @@ namespace qjs
             }
             else
             {
-                return [ctx, func_obj = JS_DupValue(ctx, val)](Args... args) -> R {
+                return [ctx, func_obj = detail::share_value(ctx, val)](Args... args) -> R {
+                    detail::allocation_scope allocations(ctx);
                     JSValue argv[sizeof...(Args)];
                     detail::wrap_args(ctx, argv, std::forward<decltype(args)>(args)...);
-                    JSValue result = JS_Call(ctx, func_obj, JS_UNDEFINED, sizeof...(Args), argv);
-                    JS_FreeValue(ctx, func_obj);
+                    JSValue result = JS_Call(ctx, *func_obj, JS_UNDEFINED, sizeof...(Args), argv);
                     for (std::size_t i = 0; i < sizeof...(Args); ++i) JS_FreeValue(ctx, argv[i]);
                     if (JS_IsException(result))
                         throw exception(ctx);
@@ -502,6 +712,107 @@ namespace qjs
         }
     };
 
+    /** Conversion traits for overload_wrappers. */
+    template<bool PassThis, detail::any_invocable... Functions>
+    struct js_traits<overload_wrapper<PassThis, Functions...>>
+    {
+        static overload_wrapper<PassThis, Functions...> unwrap(JSContext* ctx, JSValueConst val)
+        {
+            JS_ThrowTypeError(ctx, "Can't unwrap overload wrapper");
+            throw exception(ctx);
+        }
+
+        static JSValue wrap(JSContext* ctx, overload_wrapper<PassThis, Functions...> val) noexcept
+        {
+            using tuple_type = std::tuple<Functions...>;
+            auto fptr = new tuple_type(std::move(val.functions));
+
+            JSCClosure* closure = [](JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv, int binding, void* opaque) {
+                auto functions = static_cast<tuple_type*>(opaque);
+                if (!functions)
+                    return JS_NULL;
+
+                int index = detail::select_overload<PassThis, Functions...>(ctx, argc, argv);
+                if (index < 0)
+                    return JS_ThrowTypeError(ctx, "No overload matches the given arguments");
+                return detail::wrap_overload_call<PassThis>(ctx, index, *functions, this_val, argc, argv, binding);
+            };
+
+            JSCClosureFinalizerFunc* finalizer = [](void* p) {
+                delete static_cast<tuple_type*>(p);
+            };
+
+            constexpr int arity = std::max({ static_cast<int>(detail::call_signature<PassThis, Functions>::min_argc)... });
+            return JS_NewCClosure(ctx, closure, val.name, finalizer, arity, detail::binding_id(val.name), fptr);
+        }
+    };
+
+    namespace detail
+    {
+        /** Creates the object for a constructor call of registered class T.
+         *  @param new_target JS "this" of the constructor call, used to find the prototype.
+         *  @param make Callable taking a call_timer& and returning the std::shared_ptr<T> to store in the object. May throw.
+         *  @param binding Instrumentation id of the constructor (see detail::binding_id), 0 if untracked.
+         */
+        template<typename T, typename Make>
+        JSValue wrap_construct(JSContext* ctx, JSValueConst new_target, Make&& make, int binding = 0) noexcept
+        {
+            allocation_scope allocations(ctx, binding);
+            call_timer timer(binding);
+            JSValue proto = get_property_prototype(ctx, new_target);
+            if (JS_IsException(proto))
+                return proto;
+
+            if (!js_traits<std::shared_ptr<T>>::is_registered())
+                js_traits<std::shared_ptr<T>>::register_class(ctx);
+
+            JSValue jsobj = JS_NewObjectProtoClass(ctx, proto, js_traits<std::shared_ptr<T>>::qjs_class_id);
+            JS_FreeValue(ctx, proto);
+            if (JS_IsException(jsobj))
+                return jsobj;
+
+            try
+            {
+                std::shared_ptr<T> ptr = make(timer);
+                JS_SetOpaque(jsobj, new std::shared_ptr<T>(std::move(ptr)));
+                return jsobj;
+            }
+            catch (const exception&)
+            {
+                timer.failed();
+                JS_FreeValue(ctx, jsobj);
+                return JS_EXCEPTION;
+            }
+            catch (const std::exception& ex)
+            {
+                timer.failed();
+                JS_FreeValue(ctx, jsobj);
+                JS_ThrowInternalError(ctx, "%s", ex.what());
+                return JS_EXCEPTION;
+            }
+            catch (...)
+            {
+                timer.failed();
+                JS_FreeValue(ctx, jsobj);
+                JS_ThrowInternalError(ctx, "Unknown error");
+                return JS_EXCEPTION;
+            }
+        }
+
+        /** Constructs a std::shared_ptr<T> from JS arguments unwrapped as the parameters of Signature. */
+        template<typename T, typename Signature>
+        std::shared_ptr<T> make_shared_from_args(JSContext* ctx, int argc, JSValueConst* argv, call_timer& timer)
+        {
+            auto args = unwrap_args<typename function_traits<Signature>::args>(ctx, argc, argv);
+            timer.converted();
+            std::shared_ptr<T> ptr = std::apply([](auto&&... args) {
+                return std::make_shared<T>(std::forward<decltype(args)>(args)...);
+            }, std::move(args));
+            timer.returned();
+            return ptr;
+        }
+    }
+
     /** Conversion traits for ctor_wrapper. */
     template<typename T, typename... Args> requires std::constructible_from<T, Args...>
     struct js_traits<ctor_wrapper<T, Args...>>
@@ -514,43 +825,42 @@ namespace qjs
 
         static JSValue wrap(JSContext* ctx, ctor_wrapper<T, Args...> val) noexcept
         {
-            return JS_NewCFunction2(ctx, [](JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv) noexcept -> JSValue {
-                JSValue proto = detail::get_property_prototype(ctx, this_val);
-                if (JS_IsException(proto))
-                    return proto;
-
-                if (!js_traits<std::shared_ptr<T>>::is_registered())
-                    js_traits<std::shared_ptr<T>>::register_class(ctx);
+            return JS_NewCFunctionMagic(ctx, [](JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv, int binding) noexcept -> JSValue {
+                return detail::wrap_construct<T>(ctx, this_val, [&](detail::call_timer& timer) {
+                    return detail::make_shared_from_args<T, void(Args...)>(ctx, argc, argv, timer);
+                }, binding);
+            }, val.name, sizeof...(Args), JS_CFUNC_constructor_magic, detail::binding_id(val.name));
+        }
+    };
 
-                JSValue jsobj = JS_NewObjectProtoClass(ctx, proto, js_traits<std::shared_ptr<T>>::qjs_class_id);
-                JS_FreeValue(ctx, proto);
-                if (JS_IsException(jsobj))
-                    return jsobj;
+    /** Conversion traits for ctor_overload_wrapper. */
+    template<typename T, typename... Signatures>
+    struct js_traits<ctor_overload_wrapper<T, Signatures...>>
+    {
+        static ctor_overload_wrapper<T, Signatures...> unwrap(JSContext* ctx, JSValueConst val)
+        {
+            JS_ThrowTypeError(ctx, "Can't wrap constructor wrapper");
+            throw exception(ctx);
+        }
 
-                try
-                {
-                    std::shared_ptr<T> ptr = std::apply(std::make_shared<T, Args...>, detail::unwrap_args<std::tuple<Args...>>(ctx, argc, argv));
-                    JS_SetOpaque(jsobj, new std::shared_ptr<T>(std::move(ptr)));
-                    return jsobj;
-                }
-                catch (const exception&)
-                {
-                    JS_FreeValue(ctx, jsobj);
-                    return JS_EXCEPTION;
-                }
-                catch (const std::exception& ex)
-                {
-                    JS_FreeValue(ctx, jsobj);
-                    JS_ThrowInternalError(ctx, "%s", ex.what());
-                    return JS_EXCEPTION;
-                }
-                catch (...)
-                {
-                    JS_FreeValue(ctx, jsobj);
-                    JS_ThrowInternalError(ctx, "Unknown error");
-                    return JS_EXCEPTION;
-                }
-            }, val.name, sizeof...(Args), JS_CFUNC_constructor, 0);
+        static JSValue wrap(JSContext* ctx, ctor_overload_wrapper<T, Signatures...> val) noexcept
+        {
+            // same length rule as overload_wrapper: the most required arguments of any signature
+            constexpr int arity = std::max({ static_cast<int>(detail::call_signature<false, Signatures>::min_argc)... });
+            return JS_NewCFunctionMagic(ctx, [](JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv, int binding) noexcept -> JSValue {
+                int index = detail::select_overload<false, Signatures...>(ctx, argc, argv);
+                if (index < 0)
+                    return JS_ThrowTypeError(ctx, "No constructor overload matches the given arguments");
+
+                return detail::wrap_construct<T>(ctx, this_val, [&](detail::call_timer& timer) {
+                    std::shared_ptr<T> ptr;
+                    [&]<std::size_t... Is>(std::index_sequence<Is...>) {
+                        ((index == static_cast<int>(Is) &&
+                          (ptr = detail::make_shared_from_args<T, Signatures>(ctx, argc, argv, timer), true)) || ...);
+                    }(std::index_sequence_for<Signatures...>());
+                    return ptr;
+                }, binding);
+            }, val.name, arity, JS_CFUNC_constructor_magic, detail::binding_id(val.name));
         }
     };
 
@@ -596,8 +906,8 @@ namespace qjs
                 register_with_base(derived_class_id, ptr_cast_fcn);
 
             // Instrument the derived class so that it can propagate new derived classes to us.
-            auto old_register_with_base = js_traits<std::shared_ptr<D>>::registerWithBase;
-            js_traits<std::shared_ptr<D>>::registerWithBase =
+            auto old_register_with_base = js_traits<std::shared_ptr<D>>::register_with_base;
+            js_traits<std::shared_ptr<D>>::register_with_base =
                 [old_register_with_base = std::move(old_register_with_base)]
                 (JSClassID derived_class_id, derived_ptr_cast_fcn_t derived_ptr_cast_fcn) {
                     if (old_register_with_base)
@@ -680,6 +990,19 @@ namespace qjs
                     JS_ThrowInternalError(ctx, "Could not register class %s", name);
                     throw exception(ctx);
                 }
+
+                detail::register_class_info(qjs_class_id, {
+                    .name = name,
+                    .size = sizeof(T),
+                    .for_each_marked = [](void* opaque, void (*visit)(JSValueConst, void*), void* data) {
+                        const T* ptr = static_cast<std::shared_ptr<T>*>(opaque)->get();
+                        for (value T::* member : mark_offsets)
+                            visit((*ptr.*member).v, data);
+                    },
+                    .object = [](void* opaque) -> const void* {
+                        return static_cast<std::shared_ptr<T>*>(opaque)->get();
+                    }
+                });
             }
 
             JS_SetClassProto(ctx, qjs_class_id, proto);
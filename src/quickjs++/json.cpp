@@ -0,0 +1,967 @@
+#include "json.h"
+#include "internal.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace qjs
+{
+    namespace
+    {
+        /** A context of its own, which no script can reach, for built-ins that scripts may have replaced. */
+        class pristine_context
+        {
+        public:
+            explicit pristine_context(JSContext* ctx) : m_owner(ctx), m_ctx(JS_NewContextRaw(JS_GetRuntime(ctx)))
+            {
+                if (!m_ctx)
+                {
+                    JS_ThrowOutOfMemory(ctx);
+                    throw exception(ctx);
+                }
+                JS_AddIntrinsicBaseObjects(m_ctx);
+            }
+
+            pristine_context(const pristine_context&) = delete;
+            ~pristine_context() { JS_FreeContext(m_ctx); }
+
+            JSContext* get() const noexcept { return m_ctx; }
+
+            /** Takes a result of this context; failures, which can only be out of memory, are thrown in the owner's. */
+            value check(JSValue v) const
+            {
+                if (JS_IsException(v))
+                {
+                    JS_FreeValue(m_ctx, JS_GetException(m_ctx));
+                    JS_ThrowOutOfMemory(m_owner);
+                    throw exception(m_owner);
+                }
+                return value(m_ctx, std::move(v));
+            }
+
+            value global(const char* name) const
+            {
+                value global = check(JS_GetGlobalObject(m_ctx));
+                return check(JS_GetPropertyStr(m_ctx, global.v, name));
+            }
+        private:
+            JSContext* m_owner;
+            JSContext* m_ctx;
+        };
+
+        struct boxed_classes
+        {
+            JSClassID number = 0, string = 0, boolean = 0, bigint = 0;
+        };
+
+        /** Object(primitive), which boxes any primitive, including BigInts, which can't be created with new. */
+        JSValue box(JSContext* ctx, JSValue primitive)
+        {
+            if (JS_IsException(primitive))
+                return primitive;
+            JSValue global = JS_GetGlobalObject(ctx);
+            JSValue object = JS_GetPropertyStr(ctx, global, "Object");
+            JSValue boxed = JS_Call(ctx, object, JS_UNDEFINED, 1, &primitive);
+            for (JSValue v : { primitive, object, global })
+                JS_FreeValue(ctx, v);
+            return boxed;
+        }
+
+        /** Class ids of Number, String, Boolean and BigInt objects. */
+        const boxed_classes& get_boxed_classes(JSContext* ctx)
+        {
+            static const boxed_classes classes {
+                .number = detail::builtin_class_id(ctx, [](JSContext* p) { return box(p, JS_NewInt32(p, 0)); }),
+                .string = detail::builtin_class_id(ctx, [](JSContext* p) { return box(p, JS_NewString(p, "")); }),
+                .boolean = detail::builtin_class_id(ctx, [](JSContext* p) { return box(p, JS_NewBool(p, false)); }),
+                .bigint = detail::builtin_class_id(ctx, [](JSContext* p) { return box(p, JS_NewBigInt64(p, 0)); })
+            };
+            return classes;
+        }
+
+        /** Reads [[BooleanData]] of a Boolean object like JSON.stringify does, through the Boolean.prototype.valueOf
+         *  of a pristine context, since the object's own valueOf may have been overridden.
+         *  Boolean objects are rare, so the context isn't kept between calls.
+         */
+        bool boolean_data(JSContext* ctx, JSValueConst obj)
+        {
+            pristine_context pristine(ctx);
+            value proto = pristine.check(JS_GetPropertyStr(pristine.get(), pristine.global("Boolean").v, "prototype"));
+            value value_of = pristine.check(JS_GetPropertyStr(pristine.get(), proto.v, "valueOf"));
+            value result = pristine.check(JS_Call(pristine.get(), value_of.v, obj, 0, nullptr));
+            return JS_ToBool(pristine.get(), result.v) > 0;
+        }
+
+        bool is_bigint(JSValueConst v)
+        {
+            return JS_VALUE_GET_TAG(v) == JS_TAG_BIG_INT || JS_VALUE_GET_TAG(v) == JS_TAG_SHORT_BIG_INT;
+        }
+
+        /** Whether JSON.stringify writes v, rather than skipping the property or writing null in arrays. */
+        bool is_serializable(JSContext* ctx, JSValueConst v)
+        {
+            return !JS_IsUndefined(v) && !JS_IsSymbol(v) && !(JS_IsObject(v) && JS_IsFunction(ctx, v));
+        }
+
+        /** Owns the result of JS_GetOwnPropertyNames. */
+        struct property_names
+        {
+            JSContext* ctx;
+            JSPropertyEnum* tab = nullptr;
+            uint32_t length = 0;
+
+            property_names(JSContext* ctx, JSValueConst obj) : ctx(ctx)
+            {
+                if (JS_GetOwnPropertyNames(ctx, &tab, &length, obj, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) < 0)
+                    throw exception(ctx);
+            }
+            property_names(const property_names&) = delete;
+
+            ~property_names() { JS_FreePropertyEnum(ctx, tab, length); }
+        };
+
+        /** JSON.stringify's SerializeJSONProperty and friends, writing to a sink through a chunk buffer. */
+        class json_serializer
+        {
+        public:
+            json_serializer(JSContext* ctx, const json_sink& sink)
+                : m_ctx(ctx), m_sink(sink), m_classes(get_boxed_classes(ctx)), m_to_json(JS_NewAtom(ctx, "toJSON"))
+            {
+                m_buffer.reserve(json_chunk_size);
+            }
+
+            json_serializer(const json_serializer&) = delete;
+
+            ~json_serializer()
+            {
+                JS_FreeAtom(m_ctx, m_to_json);
+                for (JSAtom atom : m_property_list)
+                    JS_FreeAtom(m_ctx, atom);
+            }
+
+            void set_replacer(const value& replacer)
+            {
+                if (!JS_IsObject(replacer.v))
+                    return;
+                if (JS_IsFunction(m_ctx, replacer.v))
+                {
+                    m_replacer = replacer;
+                    return;
+                }
+                if (!JS_IsArray(replacer.v))
+                    return;
+
+                // the replacer array is the list of keys to serialize, in order and without duplicates
+                int64_t length;
+                if (JS_GetLength(m_ctx, replacer.v, &length) != 0)
+                    throw exception(m_ctx);
+                m_has_property_list = true;
+                for (int64_t i = 0; i < length; ++i)
+                {
+                    value item(m_ctx, JS_GetPropertyInt64(m_ctx, replacer.v, i));
+                    if (JS_IsException(item.v))
+                        throw exception(m_ctx);
+                    if (JS_IsObject(item.v))
+                    {
+                        JSClassID class_id = JS_GetClassID(item.v);
+                        if (class_id != m_classes.string && class_id != m_classes.number)
+                            continue;
+                        item = value(m_ctx, JS_ToString(m_ctx, item.v));
+                        if (JS_IsException(item.v))
+                            throw exception(m_ctx);
+                    }
+                    else if (!JS_IsString(item.v) && !JS_IsNumber(item.v))
+                    {
+                        continue;
+                    }
+
+                    JSAtom atom = JS_ValueToAtom(m_ctx, item.v);
+                    if (atom == JS_ATOM_NULL)
+                        throw exception(m_ctx);
+                    if (std::ranges::find(m_property_list, atom) != m_property_list.end())
+                    {
+                        JS_FreeAtom(m_ctx, atom);
+                        continue;
+                    }
+                    try
+                    {
+                        m_property_list.push_back(atom);
+                    }
+                    catch (...)
+                    {
+                        JS_FreeAtom(m_ctx, atom);
+                        throw;
+                    }
+                }
+            }
+
+            void set_space(value space)
+            {
+                if (JS_IsObject(space.v))
+                {
+                    JSClassID class_id = JS_GetClassID(space.v);
+                    if (class_id == m_classes.number)
+                        space = number_of(space);
+                    else if (class_id == m_classes.string)
+                        space = value(m_ctx, JS_ToString(m_ctx, space.v));
+                    if (JS_IsException(space.v))
+                        throw exception(m_ctx);
+                }
+
+                if (JS_IsNumber(space.v))
+                {
+                    double n = JS_VALUE_GET_TAG(space.v) == JS_TAG_INT ? JS_VALUE_GET_INT(space.v) : JS_VALUE_GET_FLOAT64(space.v);
+                    if (n >= 1)
+                        m_gap.assign(static_cast<std::size_t>(std::min(n, 10.0)), ' ');
+                }
+                else if (JS_IsString(space.v))
+                {
+                    // the first 10 code units; characters outside the BMP count as two
+                    auto gap = space.as<std::string>();
+                    std::size_t units = 0, end = 0;
+                    for (; end < gap.size(); ++end)
+                    {
+                        auto c = static_cast<unsigned char>(gap[end]);
+                        if ((c & 0xc0) == 0x80)
+                            continue;
+                        units += c >= 0xf0 ? 2 : 1;
+                        if (units > 10)
+                            break;
+                    }
+                    gap.resize(end);
+                    m_gap = std::move(gap);
+                }
+            }
+
+            void write(const value& val)
+            {
+                value holder(m_ctx, JS_UNDEFINED);
+                if (m_replacer.ctx) // the replacer is called with the wrapper object { "": val } as this
+                {
+                    holder = value(m_ctx, JS_NewObject(m_ctx));
+                    if (JS_IsException(holder.v))
+                        throw exception(m_ctx);
+                    holder[""] = val;
+                }
+
+                value prepared = prepare(holder, val, [this] { return value(m_ctx, ""); });
+                if (is_serializable(m_ctx, prepared.v))
+                    write_value(prepared);
+                flush();
+            }
+        private:
+            JSContext* m_ctx;
+            const json_sink& m_sink;
+            const boxed_classes& m_classes;
+            JSAtom m_to_json;
+            value m_replacer{JS_UNDEFINED};
+            bool m_has_property_list = false;
+            std::vector<JSAtom> m_property_list;
+            std::string m_gap;
+            std::string m_indent;
+            std::vector<JSValueConst> m_stack; // objects being serialized, to detect cycles
+            std::string m_buffer;
+
+            void check(JSValueConst v) const
+            {
+                if (JS_IsException(v))
+                    throw exception(m_ctx);
+            }
+
+            [[noreturn]] void throw_bigint() const
+            {
+                JS_ThrowTypeError(m_ctx, "BigInt value can't be serialized in JSON");
+                throw exception(m_ctx);
+            }
+
+            value number_of(const value& obj) const
+            {
+                double d;
+                if (JS_ToFloat64(m_ctx, &d, obj.v) < 0)
+                    throw exception(m_ctx);
+                return value(m_ctx, JS_NewFloat64(m_ctx, d));
+            }
+
+            /** Applies toJSON, the replacer function and unboxing to the value of property `key` of holder.
+             *  `key` makes the property name as a JS string, which is only needed when a function is called.
+             */
+            template<typename Key>
+            value prepare(const value& holder, value val, Key&& key)
+            {
+                if (JS_IsObject(val.v) || is_bigint(val.v))
+                {
+                    value to_json(m_ctx, JS_GetProperty(m_ctx, val.v, m_to_json));
+                    check(to_json.v);
+                    if (JS_IsFunction(m_ctx, to_json.v))
+                    {
+                        value name = key();
+                        JSValueConst args[] = { name.v };
+                        val = value(m_ctx, JS_Call(m_ctx, to_json.v, val.v, 1, args));
+                        check(val.v);
+                    }
+                }
+
+                if (m_replacer.ctx)
+                {
+                    value name = key();
+                    JSValueConst args[] = { name.v, val.v };
+                    val = value(m_ctx, JS_Call(m_ctx, m_replacer.v, holder.v, 2, args));
+                    check(val.v);
+                }
+
+                if (JS_IsObject(val.v))
+                {
+                    JSClassID class_id = JS_GetClassID(val.v);
+                    if (class_id == m_classes.number)
+                    {
+                        val = number_of(val);
+                    }
+                    else if (class_id == m_classes.string)
+                    {
+                        val = value(m_ctx, JS_ToString(m_ctx, val.v));
+                        check(val.v);
+                    }
+                    else if (class_id == m_classes.boolean)
+                    {
+                        val = value(m_ctx, JS_NewBool(m_ctx, boolean_data(m_ctx, val.v)));
+                    }
+                    else if (class_id == m_classes.bigint)
+                    {
+                        throw_bigint();
+                    }
+                }
+                return val;
+            }
+
+            void write_value(const value& val)
+            {
+                switch (JS_VALUE_GET_TAG(val.v))
+                {
+                case JS_TAG_NULL:
+                    append("null");
+                    break;
+                case JS_TAG_BOOL:
+                    append(JS_VALUE_GET_BOOL(val.v) ? "true" : "false");
+                    break;
+                case JS_TAG_INT:
+                    write_integer(JS_VALUE_GET_INT(val.v));
+                    break;
+                case JS_TAG_FLOAT64:
+                    write_number(val);
+                    break;
+                case JS_TAG_STRING:
+                case JS_TAG_STRING_ROPE:
+                    write_string(val.v);
+                    break;
+                case JS_TAG_BIG_INT:
+                case JS_TAG_SHORT_BIG_INT:
+                    throw_bigint();
+                default:
+                    if (JS_IsArray(val.v))
+                        write_array(val);
+                    else
+                        write_object(val);
+                }
+            }
+
+            void write_integer(int64_t n)
+            {
+                char digits[24];
+                auto result = std::to_chars(digits, digits + sizeof(digits), n);
+                append(std::string_view(digits, result.ptr - digits));
+            }
+
+            void write_number(const value& val)
+            {
+                double d = JS_VALUE_GET_FLOAT64(val.v);
+                if (!std::isfinite(d))
+                    append("null");
+                else if (d == std::trunc(d) && std::fabs(d) < 9007199254740992.0) // exact integers, -0 included
+                    write_integer(static_cast<int64_t>(d));
+                else // let the engine apply Number::toString's formatting
+                    append(val.as<std::string>());
+            }
+
+            /** Writes a JS string quoted and escaped, with unpaired surrogates as \u escapes like JSON.stringify. */
+            void write_string(JSValueConst str)
+            {
+                // CESU-8 keeps unpaired surrogates, which plain UTF-8 conversion would replace
+                std::size_t length;
+                const char* data = JS_ToCStringLen2(m_ctx, &length, str, true);
+                if (!data)
+                    throw exception(m_ctx);
+
+                try
+                {
+                    write_escaped(reinterpret_cast<const unsigned char*>(data), length);
+                }
+                catch (...)
+                {
+                    JS_FreeCString(m_ctx, data);
+                    throw;
+                }
+                JS_FreeCString(m_ctx, data);
+            }
+
+            void write_escaped(const unsigned char* data, std::size_t length)
+            {
+                static constexpr char hex[] = "0123456789abcdef";
+                auto surrogate = [&](std::size_t i) -> unsigned {
+                    if (i + 2 >= length || data[i] != 0xed || data[i + 1] < 0xa0)
+                        return 0;
+                    return 0xd000 | ((data[i + 1] & 0x3f) << 6) | (data[i + 2] & 0x3f);
+                };
+
+                append("\"");
+                std::size_t run = 0;
+                for (std::size_t i = 0; i < length;)
+                {
+                    unsigned char c = data[i];
+                    if (c >= 0x20 && c != '"' && c != '\\' && c != 0xed)
+                    {
+                        ++i;
+                        continue;
+                    }
+
+                    append(std::string_view(reinterpret_cast<const char*>(data + run), i - run));
+                    switch (c)
+                    {
+                    case '"': append("\\\""); break;
+                    case '\\': append("\\\\"); break;
+                    case '\b': append("\\b"); break;
+                    case '\f': append("\\f"); break;
+                    case '\n': append("\\n"); break;
+                    case '\r': append("\\r"); break;
+                    case '\t': append("\\t"); break;
+                    case 0xed:
+                        if (unsigned high = surrogate(i); high == 0)
+                        {
+                            // U+D000 to U+D7FF, not a surrogate
+                            append(std::string_view(reinterpret_cast<const char*>(data + i), std::min<std::size_t>(3, length - i)));
+                        }
+                        else if (unsigned low = surrogate(i + 3); high < 0xdc00 && low >= 0xdc00)
+                        {
+                            // a surrogate pair, written as the 4-byte UTF-8 sequence
+                            char32_t cp = 0x10000 + ((high - 0xd800) << 10) + (low - 0xdc00);
+                            char utf8[] = {
+                                static_cast<char>(0xf0 | (cp >> 18)),
+                                static_cast<char>(0x80 | ((cp >> 12) & 0x3f)),
+                                static_cast<char>(0x80 | ((cp >> 6) & 0x3f)),
+                                static_cast<char>(0x80 | (cp & 0x3f)) };
+                            append(std::string_view(utf8, sizeof(utf8)));
+                            i += 3;
+                        }
+                        else
+                        {
+                            char escape[] = { '\\', 'u', hex[high >> 12], hex[(high >> 8) & 0xf], hex[(high >> 4) & 0xf], hex[high & 0xf] };
+                            append(std::string_view(escape, sizeof(escape)));
+                        }
+                        i += 2; // the rest of the first sequence, with the ++i below
+                        break;
+                    default:
+                    {
+                        char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                        append(std::string_view(escape, sizeof(escape)));
+                    }
+                    }
+                    ++i;
+                    run = std::min(i, length);
+                }
+                append(std::string_view(reinterpret_cast<const char*>(data + run), length - run));
+                append("\"");
+            }
+
+            /** Pushes obj on the cycle detection stack and indents for its members. */
+            struct nesting
+            {
+                json_serializer& serializer;
+                std::size_t indent_length;
+
+                nesting(json_serializer& serializer, const value& obj)
+                    : serializer(serializer), indent_length(serializer.m_indent.size())
+                {
+                    JSContext* ctx = serializer.m_ctx;
+                    auto& stack = serializer.m_stack;
+                    if (std::ranges::any_of(stack, [&](JSValueConst v) { return JS_VALUE_GET_PTR(v) == JS_VALUE_GET_PTR(obj.v); }))
+                    {
+                        JS_ThrowTypeError(ctx, "circular reference");
+                        throw exception(ctx);
+                    }
+                    if (stack.size() >= json_max_depth)
+                    {
+                        JS_ThrowRangeError(ctx, "too many nested objects in JSON");
+                        throw exception(ctx);
+                    }
+                    stack.push_back(obj.v);
+                    serializer.m_indent += serializer.m_gap;
+                }
+                nesting(const nesting&) = delete;
+
+                ~nesting()
+                {
+                    serializer.m_stack.pop_back();
+                    serializer.m_indent.resize(indent_length);
+                }
+            };
+
+            void write_separator(bool first)
+            {
+                if (!first)
+                    append(",");
+                if (!m_gap.empty())
+                {
+                    append("\n");
+                    append(m_indent);
+                }
+            }
+
+            void write_close(bool empty, std::size_t indent_length, const char* bracket)
+            {
+                if (!empty && !m_gap.empty())
+                {
+                    append("\n");
+                    append(std::string_view(m_indent).substr(0, indent_length));
+                }
+                append(bracket);
+            }
+
+            void write_object(const value& obj)
+            {
+                nesting scope(*this, obj);
+                append("{");
+
+                bool first = true;
+                auto write_property = [&](JSAtom atom) {
+                    value val(m_ctx, JS_GetProperty(m_ctx, obj.v, atom));
+                    check(val.v);
+                    val = prepare(obj, std::move(val), [&] { return value(m_ctx, JS_AtomToString(m_ctx, atom)); });
+                    if (!is_serializable(m_ctx, val.v))
+                        return;
+
+                    write_separator(first);
+                    first = false;
+                    value name(m_ctx, JS_AtomToString(m_ctx, atom));
+                    check(name.v);
+                    write_string(name.v);
+                    append(m_gap.empty() ? ":" : ": ");
+                    write_value(val);
+                };
+
+                if (m_has_property_list)
+                {
+                    for (JSAtom atom : m_property_list)
+                        write_property(atom);
+                }
+                else
+                {
+                    property_names names(m_ctx, obj.v);
+                    for (uint32_t i = 0; i < names.length; ++i)
+                        write_property(names.tab[i].atom);
+                }
+
+                write_close(first, scope.indent_length, "}");
+            }
+
+            void write_array(const value& array)
+            {
+                nesting scope(*this, array);
+                append("[");
+
+                int64_t length;
+                if (JS_GetLength(m_ctx, array.v, &length) != 0)
+                    throw exception(m_ctx);
+                for (int64_t i = 0; i < length; ++i)
+                {
+                    value val(m_ctx, JS_GetPropertyInt64(m_ctx, array.v, i));
+                    check(val.v);
+                    val = prepare(array, std::move(val), [&] { return value(m_ctx, std::to_string(i)); });
+
+                    write_separator(i == 0);
+                    if (is_serializable(m_ctx, val.v))
+                        write_value(val);
+                    else
+                        append("null");
+                }
+
+                write_close(length == 0, scope.indent_length, "]");
+            }
+
+            void append(std::string_view str)
+            {
+                if (m_buffer.size() + str.size() > json_chunk_size)
+                {
+                    flush();
+                    if (str.size() >= json_chunk_size) // too large to be worth copying
+                    {
+                        m_sink(str);
+                        return;
+                    }
+                }
+                m_buffer.append(str);
+            }
+
+            void flush()
+            {
+                if (m_buffer.empty())
+                    return;
+                m_sink(m_buffer);
+                m_buffer.clear();
+            }
+        };
+    }
+
+    void write_json(const value& val, const json_sink& sink, const value& replacer, const value& space)
+    {
+        assert(val.ctx);
+        assert(!replacer.ctx || val.ctx == replacer.ctx);
+        assert(!space.ctx || val.ctx == space.ctx);
+
+        json_serializer serializer(val.ctx, sink);
+        serializer.set_replacer(replacer);
+        serializer.set_space(space);
+        serializer.write(val);
+    }
+
+    void write_json(const value& val, std::ostream& out, const value& replacer, const value& space)
+    {
+        write_json(val, [&out](std::string_view chunk) { out.write(chunk.data(), static_cast<std::streamsize>(chunk.size())); },
+                   replacer, space);
+    }
+
+    void value::to_json(const std::function<void(std::string_view)>& sink, const value& replacer, const value& space) const
+    {
+        write_json(*this, sink, replacer, space);
+    }
+
+    void value::to_json(std::ostream& out, const value& replacer, const value& space) const
+    {
+        write_json(*this, out, replacer, space);
+    }
+
+    void json_reader::skip_whitespace() noexcept
+    {
+        while (m_pos < m_text.size())
+        {
+            char c = m_text[m_pos];
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+                break;
+            ++m_pos;
+        }
+    }
+
+    bool json_reader::consume(char c) noexcept
+    {
+        skip_whitespace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c)
+        {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void json_reader::expect(char c)
+    {
+        if (!consume(c))
+            fail(std::string("expected '") + c + "'");
+    }
+
+    bool json_reader::consume_literal(std::string_view literal) noexcept
+    {
+        skip_whitespace();
+        if (m_text.substr(m_pos, literal.size()) != literal)
+            return false;
+        m_pos += literal.size();
+        return true;
+    }
+
+    bool json_reader::read_null()
+    {
+        return consume_literal("null");
+    }
+
+    bool json_reader::read_bool()
+    {
+        if (consume_literal("true"))
+            return true;
+        if (consume_literal("false"))
+            return false;
+        fail("expected a boolean");
+    }
+
+    std::string_view json_reader::number_token()
+    {
+        skip_whitespace();
+        std::size_t start = m_pos;
+        auto digits = [this] {
+            std::size_t first = m_pos;
+            while (m_pos < m_text.size() && m_text[m_pos] >= '0' && m_text[m_pos] <= '9')
+                ++m_pos;
+            return m_pos - first;
+        };
+        auto next_is = [this](char c) { return m_pos < m_text.size() && m_text[m_pos] == c; };
+
+        if (next_is('-'))
+            ++m_pos;
+        std::size_t integer_start = m_pos;
+        std::size_t integer_digits = digits();
+        if (integer_digits == 0 || (integer_digits > 1 && m_text[integer_start] == '0'))
+        {
+            m_pos = start;
+            fail("expected a number");
+        }
+        if (next_is('.'))
+        {
+            ++m_pos;
+            if (digits() == 0)
+                fail("expected a digit");
+        }
+        if (next_is('e') || next_is('E'))
+        {
+            ++m_pos;
+            if (next_is('+') || next_is('-'))
+                ++m_pos;
+            if (digits() == 0)
+                fail("expected a digit");
+        }
+        return m_text.substr(start, m_pos - start);
+    }
+
+    double json_reader::to_double(std::string_view token) const
+    {
+        double result;
+        auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), result);
+        if (ec == std::errc::result_out_of_range) // like JSON.parse, overflow to infinity and underflow to zero
+            return std::strtod(std::string(token).c_str(), nullptr);
+        return result;
+    }
+
+    double json_reader::read_double()
+    {
+        return to_double(number_token());
+    }
+
+    void json_reader::read_string(std::string& str)
+    {
+        expect('"');
+        str.clear();
+        auto append_utf8 = [&str](char32_t cp) {
+            if (cp < 0x80)
+            {
+                str += static_cast<char>(cp);
+            }
+            else if (cp < 0x800)
+            {
+                str += static_cast<char>(0xc0 | (cp >> 6));
+                str += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+            else if (cp < 0x10000)
+            {
+                str += static_cast<char>(0xe0 | (cp >> 12));
+                str += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                str += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+            else
+            {
+                str += static_cast<char>(0xf0 | (cp >> 18));
+                str += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+                str += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                str += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+        };
+        auto read_hex4 = [this]() -> char32_t {
+            if (m_text.size() - m_pos < 4)
+                fail("expected 4 hex digits");
+            char32_t result = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char c = m_text[m_pos++];
+                int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if (digit < 0)
+                    fail("expected a hex digit");
+                result = (result << 4) | digit;
+            }
+            return result;
+        };
+
+        for (;;)
+        {
+            std::size_t run = m_pos;
+            while (m_pos < m_text.size())
+            {
+                auto c = static_cast<unsigned char>(m_text[m_pos]);
+                if (c == '"' || c == '\\' || c < 0x20)
+                    break;
+                ++m_pos;
+            }
+            str.append(m_text.substr(run, m_pos - run));
+            if (m_pos >= m_text.size())
+                fail("unterminated string");
+
+            char c = m_text[m_pos++];
+            if (c == '"')
+                return;
+            if (c != '\\')
+            {
+                --m_pos;
+                fail("control character in string");
+            }
+            if (m_pos >= m_text.size())
+                fail("unterminated string");
+
+            switch (m_text[m_pos++])
+            {
+            case '"': str += '"'; break;
+            case '\\': str += '\\'; break;
+            case '/': str += '/'; break;
+            case 'b': str += '\b'; break;
+            case 'f': str += '\f'; break;
+            case 'n': str += '\n'; break;
+            case 'r': str += '\r'; break;
+            case 't': str += '\t'; break;
+            case 'u':
+            {
+                char32_t cp = read_hex4();
+                if (cp >= 0xd800 && cp < 0xdc00 && m_text.substr(m_pos, 2) == "\\u")
+                {
+                    std::size_t low_start = m_pos;
+                    m_pos += 2;
+                    char32_t low = read_hex4();
+                    if (low >= 0xdc00 && low < 0xe000)
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    else
+                        m_pos = low_start;
+                }
+                if (cp >= 0xd800 && cp < 0xe000) // unpaired surrogates have no UTF-8 encoding
+                    cp = 0xfffd;
+                append_utf8(cp);
+                break;
+            }
+            default:
+                --m_pos;
+                fail("invalid escape");
+            }
+        }
+    }
+
+    void json_reader::skip()
+    {
+        // containers go through read_object and read_array, so skipped values are held to the same grammar and depth
+        skip_whitespace();
+        if (m_pos >= m_text.size())
+            fail("unexpected end");
+
+        switch (m_text[m_pos])
+        {
+        case '"':
+        {
+            std::string ignored;
+            read_string(ignored);
+            break;
+        }
+        case '{':
+            read_object([this](std::string_view) { skip(); });
+            break;
+        case '[':
+            read_array([this] { skip(); });
+            break;
+        case 't':
+        case 'f':
+            read_bool();
+            break;
+        case 'n':
+            if (!read_null())
+                fail("expected null");
+            break;
+        default:
+            number_token();
+        }
+    }
+
+    void json_reader::finish()
+    {
+        skip_whitespace();
+        if (m_pos != m_text.size())
+            fail("unexpected characters after the value");
+    }
+
+    void json_writer::write_double(double d)
+    {
+        separate();
+        if (!std::isfinite(d))
+        {
+            append("null");
+            return;
+        }
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), d);
+        append(std::string_view(digits, result.ptr - digits));
+    }
+
+    void json_writer::write_string(std::string_view str)
+    {
+        static constexpr char hex[] = "0123456789abcdef";
+        separate();
+        append("\"");
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < str.size(); ++i)
+        {
+            auto c = static_cast<unsigned char>(str[i]);
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+
+            append(str.substr(run, i - run));
+            run = i + 1;
+            switch (c)
+            {
+            case '"': append("\\\""); break;
+            case '\\': append("\\\\"); break;
+            case '\b': append("\\b"); break;
+            case '\f': append("\\f"); break;
+            case '\n': append("\\n"); break;
+            case '\r': append("\\r"); break;
+            case '\t': append("\\t"); break;
+            default:
+            {
+                char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                append(std::string_view(escape, sizeof(escape)));
+            }
+            }
+        }
+        append(str.substr(run));
+        append("\"");
+    }
+
+    void json_writer::write_key(std::string_view key)
+    {
+        write_string(key);
+        append(":");
+        m_need_comma = false;
+    }
+
+    void json_writer::append(std::string_view str)
+    {
+        if (m_sink && m_buffer.size() + str.size() > json_chunk_size)
+        {
+            flush();
+            if (str.size() >= json_chunk_size)
+            {
+                (*m_sink)(str);
+                return;
+            }
+        }
+        m_buffer.append(str);
+    }
+
+    void json_writer::flush()
+    {
+        if (!m_sink || m_buffer.empty())
+            return;
+        (*m_sink)(m_buffer);
+        m_buffer.clear();
+    }
+}
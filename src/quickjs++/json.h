@@ -0,0 +1,446 @@
+#pragma once
+#include "value.h"
+#include <charconv>
+#include <cmath>
+#include <concepts>
+#include <functional>
+#include <iosfwd>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace qjs
+{
+    /** Receives JSON text in chunks, e.g. to write it to a socket or append it to a buffer chain.
+     *  A chunk is only valid during the call.
+     */
+    using json_sink = std::function<void(std::string_view chunk)>;
+
+    /** Serializes `val` like JSON.stringify(val, replacer, space), handing the text to `sink` in chunks of about
+     *  json_chunk_size bytes as it goes, instead of building the whole text as a JS string and copying it.
+     *  Memory use is bounded by the chunk size and the largest single string in `val`, not the size of the output.
+     *  toJSON methods, replacer functions and arrays, boxed primitives, getters and cycle detection behave as in
+     *  JSON.stringify; proxies of arrays are serialized as objects. Nothing is written if JSON.stringify would
+     *  return undefined, e.g. for functions. Objects nested more than json_max_depth deep throw a RangeError.
+     *  If an exception is thrown midway, the chunks already handed to `sink` are an incomplete document.
+     *  @throws exception, and whatever `sink` throws.
+     */
+    void write_json(const value& val, const json_sink& sink,
+                    const value& replacer = value(JS_UNDEFINED), const value& space = value(JS_UNDEFINED));
+
+    /** Same as write_json(val, sink, replacer, space), writing to a stream. */
+    void write_json(const value& val, std::ostream& out,
+                    const value& replacer = value(JS_UNDEFINED), const value& space = value(JS_UNDEFINED));
+
+    inline constexpr std::size_t json_chunk_size = 16 * 1024;
+    inline constexpr std::size_t json_max_depth = 1000;
+
+    /** Error in JSON text decoded by from_json. */
+    class json_error : public std::runtime_error
+    {
+    public:
+        json_error(const std::string& what, std::size_t offset)
+            : std::runtime_error(what + " at offset " + std::to_string(offset)), m_offset(offset) {}
+
+        /** Byte offset into the JSON text where decoding failed. */
+        std::size_t offset() const noexcept { return m_offset; }
+    private:
+        std::size_t m_offset;
+    };
+
+    /** Pull parser over JSON text, used by json_traits<T>::read. The text must outlive the reader. */
+    class json_reader
+    {
+    public:
+        explicit json_reader(std::string_view text) noexcept : m_text(text) {}
+
+        /** Consumes `null` if it comes next. */
+        bool read_null();
+        bool read_bool();
+        double read_double();
+        std::string read_string() { std::string str; read_string(str); return str; }
+        /** Reads a string into `str`, reusing its storage. Escapes are decoded to UTF-8. */
+        void read_string(std::string& str);
+
+        template<typename T> requires std::integral<T>
+        T read_integer()
+        {
+            std::string_view token = number_token();
+            T result;
+            auto [end, ec] = std::from_chars(token.data(), token.data() + token.size(), result);
+            if (ec == std::errc() && end == token.data() + token.size())
+                return result;
+
+            // integral values written with a fraction or exponent, e.g. 1.0 or 1e3
+            constexpr double limit = 2.0 * static_cast<double>(std::numeric_limits<T>::max() / 2 + 1);
+            double d = to_double(token);
+            if (d != std::trunc(d) || d < static_cast<double>(std::numeric_limits<T>::min()) || d >= limit)
+                fail("expected an integer in range");
+            return static_cast<T>(d);
+        }
+
+        /** Reads an object, calling `on_member(std::string_view key)` for each member, which must read its value.
+         *  The key is only valid until the value is read.
+         *  @throws json_error if objects and arrays nest more than json_max_depth deep.
+         */
+        template<typename F>
+        void read_object(F&& on_member)
+        {
+            expect('{');
+            enter();
+            if (!consume('}'))
+            {
+                std::string key;
+                do
+                {
+                    read_string(key);
+                    expect(':');
+                    on_member(std::string_view(key));
+                } while (consume(','));
+                expect('}');
+            }
+            --m_depth;
+        }
+
+        /** Reads an array, calling `on_element()` for each element, which must read it.
+         *  @throws json_error if objects and arrays nest more than json_max_depth deep.
+         */
+        template<typename F>
+        void read_array(F&& on_element)
+        {
+            expect('[');
+            enter();
+            if (!consume(']'))
+            {
+                do
+                    on_element();
+                while (consume(','));
+                expect(']');
+            }
+            --m_depth;
+        }
+
+        /** Skips the next value, whatever its type, checking that it is well-formed.
+         *  @throws json_error if it is not, or nests more than json_max_depth deep.
+         */
+        void skip();
+
+        /** Throws if anything but whitespace is left. */
+        void finish();
+
+        [[noreturn]] void fail(const std::string& what) const { throw json_error(what, m_pos); }
+    private:
+        std::string_view m_text;
+        std::size_t m_pos = 0;
+        // objects and arrays being read, so that recursive types can't overflow the stack on hostile input
+        std::size_t m_depth = 0;
+
+        void enter()
+        {
+            if (m_depth >= json_max_depth)
+                fail("nested too deeply");
+            ++m_depth;
+        }
+
+        void skip_whitespace() noexcept;
+        bool consume(char c) noexcept;
+        void expect(char c);
+        bool consume_literal(std::string_view literal) noexcept;
+        std::string_view number_token();
+        double to_double(std::string_view token) const;
+    };
+
+    /** Writes compact JSON text, used by json_traits<T>::write. Commas are inserted automatically. */
+    class json_writer
+    {
+    public:
+        /** Collects the text, for take(). */
+        json_writer() = default;
+
+        /** Hands the text to `sink` in chunks of about json_chunk_size bytes. Call flush() when done. */
+        explicit json_writer(const json_sink& sink) : m_sink(&sink) {}
+
+        json_writer(const json_writer&) = delete;
+
+        void write_null() { separate(); append("null"); }
+        void write_bool(bool b) { separate(); append(b ? "true" : "false"); }
+        /** Writes null for NaN and infinities, as JSON.stringify does. */
+        void write_double(double d);
+        void write_string(std::string_view str);
+
+        template<typename T> requires std::integral<T>
+        void write_integer(T n)
+        {
+            separate();
+            char digits[24];
+            auto result = std::to_chars(digits, digits + sizeof(digits), n);
+            append(std::string_view(digits, result.ptr - digits));
+        }
+
+        void begin_object() { separate(); append("{"); m_need_comma = false; }
+        void end_object() { append("}"); m_need_comma = true; }
+        void begin_array() { separate(); append("["); m_need_comma = false; }
+        void end_array() { append("]"); m_need_comma = true; }
+
+        /** Writes an object member's key; its value is written next. */
+        void write_key(std::string_view key);
+
+        /** Hands the buffered text to the sink. */
+        void flush();
+
+        /** Returns the text collected so far. */
+        std::string take() noexcept { return std::move(m_buffer); }
+    private:
+        const json_sink* m_sink = nullptr;
+        std::string m_buffer;
+        bool m_need_comma = false;
+
+        void separate()
+        {
+            if (m_need_comma)
+                append(",");
+            m_need_comma = true;
+        }
+
+        void append(std::string_view str);
+    };
+
+    /** JSON conversion traits. Describes how to decode type T from JSON text and encode it, without going through
+     *  JS values. Specialized for arithmetic types, std::string, std::optional, std::vector and maps with string keys;
+     *  structs derive their specialization from json_struct.
+     */
+    template<typename T>
+    struct json_traits
+    {
+        json_traits() = delete;
+
+        /** Reads the next value from `in` as T.
+         *  This function is intentionally not implemented. User should implement this function for their own type.
+         *  @throws json_error
+         */
+        static T read(json_reader& in) = delete;
+
+        /** Writes `val` to `out`.
+         *  This function is intentionally not implemented. User should implement this function for their own type.
+         */
+        static void write(json_writer& out, const T& val) = delete;
+    };
+
+    /** Concept satisfied by any type that has a proper associated implementation of json_traits. */
+    template<typename T>
+    concept has_json_traits = requires(json_reader& in, json_writer& out, const T& val) {
+        { json_traits<T>::read(in) } -> std::convertible_to<T>;
+        { json_traits<T>::write(out, val) } -> std::same_as<void>;
+    };
+
+    /** Decodes JSON text directly into a C++ value, without creating JS objects.
+     *  @throws json_error
+     */
+    template<typename T> requires has_json_traits<T>
+    T from_json(std::string_view text)
+    {
+        json_reader in(text);
+        T result = json_traits<T>::read(in);
+        in.finish();
+        return result;
+    }
+
+    /** Encodes a C++ value as compact JSON text, without creating JS values. */
+    template<typename T> requires has_json_traits<T>
+    std::string to_json(const T& val)
+    {
+        json_writer out;
+        json_traits<T>::write(out, val);
+        return out.take();
+    }
+
+    /** Encodes a C++ value as compact JSON text, handing it to `sink` in chunks. */
+    template<typename T> requires has_json_traits<T>
+    void to_json(const T& val, const json_sink& sink)
+    {
+        json_writer out(sink);
+        json_traits<T>::write(out, val);
+        out.flush();
+    }
+
+    template<>
+    struct json_traits<bool>
+    {
+        static bool read(json_reader& in) { return in.read_bool(); }
+        static void write(json_writer& out, bool val) { out.write_bool(val); }
+    };
+
+    template<typename T> requires std::integral<T>
+    struct json_traits<T>
+    {
+        static T read(json_reader& in) { return in.read_integer<T>(); }
+        static void write(json_writer& out, T val) { out.write_integer(val); }
+    };
+
+    template<typename T> requires std::floating_point<T>
+    struct json_traits<T>
+    {
+        static T read(json_reader& in) { return static_cast<T>(in.read_double()); }
+        static void write(json_writer& out, T val) { out.write_double(static_cast<double>(val)); }
+    };
+
+    template<>
+    struct json_traits<std::string>
+    {
+        static std::string read(json_reader& in) { return in.read_string(); }
+        static void write(json_writer& out, const std::string& val) { out.write_string(val); }
+    };
+
+    /** null decodes to an empty optional, and an empty optional encodes to null. Empty optional members of
+     *  json_struct types are left out instead.
+     */
+    template<typename T>
+    struct json_traits<std::optional<T>>
+    {
+        static std::optional<T> read(json_reader& in)
+        {
+            if (in.read_null())
+                return std::nullopt;
+            return json_traits<T>::read(in);
+        }
+
+        static void write(json_writer& out, const std::optional<T>& val)
+        {
+            if (val)
+                json_traits<T>::write(out, *val);
+            else
+                out.write_null();
+        }
+    };
+
+    template<typename T>
+    struct json_traits<std::vector<T>>
+    {
+        static std::vector<T> read(json_reader& in)
+        {
+            std::vector<T> result;
+            in.read_array([&] { result.push_back(json_traits<T>::read(in)); });
+            return result;
+        }
+
+        static void write(json_writer& out, const std::vector<T>& val)
+        {
+            out.begin_array();
+            for (const T& element : val)
+                json_traits<T>::write(out, element);
+            out.end_array();
+        }
+    };
+
+    namespace detail
+    {
+        /** json_traits of maps with string keys, as objects. */
+        template<typename Map>
+        struct json_map_traits
+        {
+            using mapped_type = typename Map::mapped_type;
+
+            static Map read(json_reader& in)
+            {
+                Map result;
+                in.read_object([&](std::string_view key) {
+                    std::string name(key); // the key is overwritten by nested objects
+                    result.insert_or_assign(std::move(name), json_traits<mapped_type>::read(in));
+                });
+                return result;
+            }
+
+            static void write(json_writer& out, const Map& val)
+            {
+                out.begin_object();
+                for (const auto& [key, element] : val)
+                {
+                    out.write_key(key);
+                    json_traits<mapped_type>::write(out, element);
+                }
+                out.end_object();
+            }
+        };
+
+        template<typename T>
+        struct is_optional : std::false_type {};
+
+        template<typename T>
+        struct is_optional<std::optional<T>> : std::true_type {};
+    }
+
+    template<typename T, typename Compare, typename Allocator>
+    struct json_traits<std::map<std::string, T, Compare, Allocator>>
+        : detail::json_map_traits<std::map<std::string, T, Compare, Allocator>> {};
+
+    template<typename T, typename Hash, typename KeyEqual, typename Allocator>
+    struct json_traits<std::unordered_map<std::string, T, Hash, KeyEqual, Allocator>>
+        : detail::json_map_traits<std::unordered_map<std::string, T, Hash, KeyEqual, Allocator>> {};
+
+    /** A named data member of a struct, for json_struct. */
+    template<typename T, typename M>
+    struct json_field
+    {
+        const char* name;
+        M T::* member;
+    };
+
+    /** Base of json_traits specializations for structs, which list their members in a static `fields` tuple.
+     *  Members missing from the JSON text keep their default values, unknown keys are skipped, and empty
+     *  std::optional members are left out when encoding.
+     *  Example:
+     *  template<>
+     *  struct qjs::json_traits<point> : qjs::json_struct<point>
+     *  {
+     *      static constexpr std::tuple fields { qjs::json_field { "x", &point::x }, qjs::json_field { "y", &point::y } };
+     *  };
+     */
+    template<typename T>
+    struct json_struct
+    {
+        static T read(json_reader& in)
+        {
+            T result{};
+            in.read_object([&](std::string_view key) {
+                bool found = std::apply([&](const auto&... fields) {
+                    return ((key == fields.name && (read_field(in, result.*fields.member), true)) || ...);
+                }, json_traits<T>::fields);
+                if (!found)
+                    in.skip();
+            });
+            return result;
+        }
+
+        static void write(json_writer& out, const T& val)
+        {
+            out.begin_object();
+            std::apply([&](const auto&... fields) { (write_field(out, fields.name, val.*fields.member), ...); },
+                       json_traits<T>::fields);
+            out.end_object();
+        }
+    private:
+        template<typename M>
+        static void read_field(json_reader& in, M& member)
+        {
+            member = json_traits<M>::read(in);
+        }
+
+        template<typename M>
+        static void write_field(json_writer& out, const char* name, const M& member)
+        {
+            if constexpr (detail::is_optional<M>::value)
+            {
+                if (!member)
+                    return;
+            }
+            out.write_key(name);
+            json_traits<M>::write(out, member);
+        }
+    };
+}
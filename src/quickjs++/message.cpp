@@ -0,0 +1,54 @@
+#include "message.h"
+#include "runtime.h"
+
+namespace qjs
+{
+    message::message(const value& val, const std::vector<value>& transfer)
+    {
+        JSContext* ctx = val.ctx;
+        for (const value& buffer : transfer)
+        {
+            if (!JS_IsArrayBuffer(buffer.v))
+            {
+                JS_ThrowTypeError(ctx, "Only ArrayBuffers can be transferred");
+                throw exception(ctx);
+            }
+        }
+
+        // SharedArrayBuffers are written as pointers, which only outlive the sender if shared_buffer allocated them
+        bool allow_shared = runtime::get(JS_GetRuntime(ctx));
+        std::size_t size;
+        JSSABTab shared {};
+        uint8_t* data = JS_WriteObject2(ctx, &size, val.v,
+                                        JS_WRITE_OBJ_REFERENCE | (allow_shared ? JS_WRITE_OBJ_SAB : 0), &shared);
+        if (!data)
+            throw exception(ctx);
+
+        // the buffer is owned by the sending runtime's allocator, which can't be used from other threads
+        m_data.assign(data, data + size);
+        js_free(ctx, data);
+
+        m_shared.reserve(shared.len);
+        for (std::size_t i = 0; i < shared.len; ++i)
+            m_shared.push_back(shared_buffer::from_data(shared.tab[i]));
+        js_free(ctx, shared.tab);
+
+        for (const value& buffer : transfer)
+            JS_DetachArrayBuffer(ctx, buffer.v);
+    }
+
+    value message::read(context& context) const
+    {
+        if (!m_shared.empty() && !runtime::get(JS_GetRuntime(context.ctx)))
+        {
+            JS_ThrowTypeError(context.ctx, "Messages with SharedArrayBuffers can only be read in a qjs::runtime");
+            throw exception(context.ctx);
+        }
+
+        int flags = JS_READ_OBJ_REFERENCE | (m_shared.empty() ? 0 : JS_READ_OBJ_SAB);
+        value result(context.ctx, JS_ReadObject(context.ctx, m_data.data(), m_data.size(), flags));
+        if (JS_IsException(result.v))
+            throw exception(context.ctx);
+        return result;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "context.h"
+#include "shared_buffer.h"
+#include <vector>
+
+namespace qjs
+{
+    /** A JS value serialized for passing to another runtime, like the structured clone of postMessage.
+     *  Uses the engine's binary object format, which is much cheaper than a JSON round trip and keeps
+     *  shared references, cycles and typed arrays intact. A message owns its bytes and may be moved
+     *  to and read on any thread, any number of times.
+     *  SharedArrayBuffers are passed by reference and stay shared between sender and receivers;
+     *  both ends must then be qjs::runtime instances, whose SharedArrayBuffers are allocated by shared_buffer.
+     *  Example:
+     *  qjs::message msg(ctx1.eval("({ data: new Uint8Array(1024) })"));
+     *  // on another thread:
+     *  qjs::value copy = msg.read(ctx2);
+     */
+    class message
+    {
+    public:
+        /** Serialize `val`.
+         *  @param transfer ArrayBuffers to transfer: they are detached in the sending context once serialized.
+         *  @throws exception if `val` contains something that can't be serialized, e.g. functions.
+         */
+        explicit message(const value& val, const std::vector<value>& transfer = {});
+
+        message(message&&) noexcept = default;
+        message& operator=(message&&) noexcept = default;
+        message(const message&) = default;
+
+        /** Create a copy of the serialized value in a context. */
+        value read(context& context) const;
+
+        /** Size of the serialized value in bytes. */
+        std::size_t size() const noexcept { return m_data.size(); }
+    private:
+        std::vector<uint8_t> m_data;
+        std::vector<shared_buffer> m_shared; // keeps the SharedArrayBuffers referenced by m_data alive
+    };
+}
@@ -0,0 +1,203 @@
+#include "profiler.h"
+#include "runtime.h"
+#include <algorithm>
+#include <sstream>
+
+namespace qjs
+{
+    namespace
+    {
+        /** Turns one line of Error.stack, like "    at f (file.js:3:5)", into a frame label like "f (file.js:3)". */
+        std::string frame_label(std::string_view line)
+        {
+            line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+            if (!line.starts_with("at ")) // e.g. a leading "Error" line
+                return {};
+            line.remove_prefix(3);
+
+            std::string label(line);
+            // drop the column, so samples anywhere on a line are merged
+            std::size_t colon = label.rfind(':');
+            if (label.ends_with(')') && colon != std::string::npos &&
+                std::all_of(label.begin() + colon + 1, label.end() - 1, [](char c) { return c >= '0' && c <= '9'; }))
+            {
+                label.erase(colon, label.size() - colon - 1);
+            }
+
+            // ';' separates frames in the folded format
+            std::ranges::replace(label, ';', ',');
+            return label;
+        }
+
+        /** Converts Error.stack (innermost frame first) into a folded stack (outermost frame first).
+         *  Stacks deeper than max_depth keep their innermost frames under a "(truncated)" root.
+         */
+        std::string fold_stack(std::string_view stack, std::size_t max_depth)
+        {
+            std::vector<std::string> frames;
+            while (!stack.empty())
+            {
+                std::size_t end = std::min(stack.find('\n'), stack.size());
+                if (std::string frame = frame_label(stack.substr(0, end)); !frame.empty())
+                    frames.push_back(std::move(frame));
+                stack.remove_prefix(std::min(end + 1, stack.size()));
+            }
+
+            if (frames.size() > max_depth)
+            {
+                frames.resize(max_depth);
+                frames.push_back("(truncated)");
+            }
+
+            std::string folded;
+            for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+            {
+                if (!folded.empty())
+                    folded += ';';
+                folded += *it;
+            }
+            return folded;
+        }
+
+        /** Installs an interrupt handler through qjs::runtime where there is one, so that it is known to others. */
+        void set_interrupt_handler(JSRuntime* rt, runtime::interrupt_callback* handler, void* opaque)
+        {
+            if (runtime* owner = runtime::get(rt))
+                owner->set_interrupt_handler(handler, opaque);
+            else
+                JS_SetInterruptHandler(rt, handler, opaque);
+        }
+    }
+
+    profiler::profiler(context& context, std::size_t max_depth) : m_max_depth(max_depth)
+    {
+        // a context of its own, which scripts can't reach, so no Error.prepareStackTrace or getter of theirs runs
+        // while a stack is captured, and the depth limit is ours alone
+        m_sampler = JS_NewContextRaw(JS_GetRuntime(context.ctx));
+        if (!m_sampler)
+            throw std::runtime_error("Cannot create profiler context");
+        JS_AddIntrinsicBaseObjects(m_sampler);
+
+        // one frame more than kept, to tell truncated stacks from stacks of exactly max_depth frames
+        JSValue global = JS_GetGlobalObject(m_sampler);
+        JSValue error = JS_GetPropertyStr(m_sampler, global, "Error");
+        int limit = static_cast<int>(std::min<std::size_t>(max_depth + 1, INT32_MAX));
+        JS_SetPropertyStr(m_sampler, error, "stackTraceLimit", JS_NewInt32(m_sampler, limit));
+        JS_FreeValue(m_sampler, error);
+        JS_FreeValue(m_sampler, global);
+    }
+
+    profiler::~profiler()
+    {
+        stop();
+        JS_FreeContext(m_sampler);
+    }
+
+    void profiler::start(std::chrono::microseconds interval)
+    {
+        if (running())
+            return;
+
+        m_stopping = false;
+        m_timer = std::thread([this, interval] {
+            std::unique_lock lock(m_timer_mutex);
+            while (!m_timer_wake.wait_for(lock, interval, [this] { return m_stopping; }))
+                m_sample_due.store(true, std::memory_order_relaxed);
+        });
+
+        // the engine has a single interrupt handler, so the one installed before is kept and called from ours
+        JSRuntime* rt = JS_GetRuntime(m_sampler);
+        if (runtime* owner = runtime::get(rt))
+            std::tie(m_previous_handler, m_previous_opaque) = owner->interrupt_handler();
+        set_interrupt_handler(rt, interrupt_handler, this);
+    }
+
+    void profiler::stop()
+    {
+        if (!running())
+            return;
+
+        set_interrupt_handler(JS_GetRuntime(m_sampler), m_previous_handler, m_previous_opaque);
+        m_previous_handler = nullptr;
+        m_previous_opaque = nullptr;
+        {
+            std::lock_guard lock(m_timer_mutex);
+            m_stopping = true;
+        }
+        m_timer_wake.notify_one();
+        m_timer.join();
+        m_sample_due = false;
+    }
+
+    std::size_t profiler::samples() const
+    {
+        std::lock_guard lock(m_samples_mutex);
+        return m_samples;
+    }
+
+    void profiler::write_folded(std::ostream& out) const
+    {
+        std::lock_guard lock(m_samples_mutex);
+        for (const auto& [stack, count] : m_stacks)
+            out << stack << ' ' << count << '\n';
+    }
+
+    std::string profiler::folded() const
+    {
+        std::ostringstream out;
+        write_folded(out);
+        return out.str();
+    }
+
+    void profiler::clear()
+    {
+        std::lock_guard lock(m_samples_mutex);
+        m_stacks.clear();
+        m_samples = 0;
+    }
+
+    int profiler::interrupt_handler(JSRuntime* rt, void* opaque)
+    {
+        auto self = static_cast<profiler*>(opaque);
+        if (self->m_sample_due.exchange(false, std::memory_order_relaxed))
+            self->take_sample();
+        return self->m_previous_handler ? self->m_previous_handler(rt, self->m_previous_opaque) : 0;
+    }
+
+    void profiler::take_sample()
+    {
+        // the backtrace is taken from the runtime's current stack frame, whichever context is running
+        JSValue error = JS_NewError(m_sampler);
+        if (JS_IsException(error))
+        {
+            JS_FreeValue(m_sampler, JS_GetException(m_sampler));
+            return;
+        }
+
+        JSValue stack = JS_GetPropertyStr(m_sampler, error, "stack");
+        JS_FreeValue(m_sampler, error);
+        if (!JS_IsString(stack))
+        {
+            JS_FreeValue(m_sampler, stack);
+            return;
+        }
+
+        std::size_t length;
+        const char* str = JS_ToCStringLen(m_sampler, &length, stack);
+        JS_FreeValue(m_sampler, stack);
+        if (!str)
+        {
+            JS_FreeValue(m_sampler, JS_GetException(m_sampler));
+            return;
+        }
+
+        std::string folded = fold_stack(std::string_view(str, length), m_max_depth);
+        JS_FreeCString(m_sampler, str);
+        if (folded.empty())
+            return;
+
+        std::lock_guard lock(m_samples_mutex);
+        ++m_stacks[std::move(folded)];
+        ++m_samples;
+    }
+}
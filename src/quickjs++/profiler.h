@@ -0,0 +1,79 @@
+#pragma once
+#include "context.h"
+#include "runtime.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_map>
+
+namespace qjs
+{
+    /** Sampling CPU profiler for the JS code running in a runtime.
+     *  While started, a timer thread requests a sample every interval and the runtime's interrupt handler,
+     *  which the engine polls regularly while executing JS, records the current JS stack.
+     *  Time spent outside of JS (idle, or in long native calls) is not sampled.
+     *  An interrupt handler installed before through runtime::set_interrupt_handler is still called while sampling
+     *  and reinstalled when stopped, so a stopped profiler costs nothing. The engine can't report handlers set
+     *  with JS_SetInterruptHandler directly, so those are replaced.
+     *  Stacks are captured through a private context, so no script code runs while sampling.
+     *  Stacks deeper than max_depth keep their innermost frames under a synthetic "(truncated)" root.
+     *  Must be destroyed before the runtime.
+     *  Example:
+     *  qjs::profiler profiler(context);
+     *  profiler.start();
+     *  context.eval(...);
+     *  profiler.stop();
+     *  profiler.write_folded(std::ofstream("profile.folded")); // for flamegraph.pl or speedscope
+     */
+    class profiler
+    {
+    public:
+        /** @param context Context whose runtime is sampled. Samples cover all contexts of the runtime.
+         *  @param max_depth Number of innermost frames kept per stack.
+         */
+        explicit profiler(context& context, std::size_t max_depth = 128);
+        profiler(const profiler&) = delete;
+        ~profiler();
+
+        /** Start sampling. Chains to the runtime's interrupt handler until stopped. */
+        void start(std::chrono::microseconds interval = std::chrono::milliseconds(1));
+
+        /** Stop sampling. Collected samples are kept. */
+        void stop();
+
+        bool running() const noexcept { return m_timer.joinable(); }
+
+        /** Number of samples collected. */
+        std::size_t samples() const;
+
+        /** Write collected samples in folded stack format: one "outer;...;inner count" line per distinct stack. */
+        void write_folded(std::ostream& out) const;
+
+        /** Collected samples in folded stack format. */
+        std::string folded() const;
+
+        /** Discard collected samples. */
+        void clear();
+    private:
+        JSContext* m_sampler;
+        std::size_t m_max_depth;
+        runtime::interrupt_callback* m_previous_handler = nullptr;
+        void* m_previous_opaque = nullptr;
+
+        std::thread m_timer;
+        std::mutex m_timer_mutex;
+        std::condition_variable m_timer_wake;
+        bool m_stopping = false;
+        std::atomic<bool> m_sample_due { false };
+
+        mutable std::mutex m_samples_mutex;
+        std::unordered_map<std::string, std::size_t> m_stacks;
+        std::size_t m_samples = 0;
+
+        static int interrupt_handler(JSRuntime* rt, void* opaque);
+        void take_sample();
+    };
+}
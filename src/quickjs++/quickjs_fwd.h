@@ -25,6 +25,7 @@ struct JSValue;
 // forward declarations for this library
 namespace qjs
 {
+class completion_queue;
 class context;
 class module;
 class runtime;
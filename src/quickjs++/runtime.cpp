@@ -1,24 +1,46 @@
 #include "runtime.h"
+#include "allocations.h"
+#include "completion_queue.h"
 #include "context.h"
+#include "shared_buffer.h"
+#include "tracing.h"
 
 namespace qjs
 {
-    runtime::runtime()
+    runtime::runtime() : m_completions(std::make_shared<completion_queue>())
     {
-        if (!(rt = JS_NewRuntime()))
+        if (allocations::enabled())
+        {
+            m_allocations = std::make_unique<detail::allocation_tracker>();
+            detail::allocation_scope scope(nullptr, 0); // the runtime's own memory belongs to no context
+            rt = JS_NewRuntime2(&detail::allocation_tracker::functions, m_allocations.get());
+        }
+        else
+        {
+            rt = JS_NewRuntime();
+        }
+
+        if (!rt)
             throw std::runtime_error("Cannot create runtime");
 
+        JS_SetRuntimeOpaque(rt, this);
+        JS_SetSharedArrayBufferFunctions(rt, &shared_buffer::functions);
         JS_SetHostPromiseRejectionTracker(rt, promise_rejection_tracker, nullptr);
         JS_SetModuleLoaderFunc(rt, nullptr, module_loader, nullptr);
     }
 
     runtime::~runtime()
     {
+        m_completions->close();
         JS_FreeRuntime(rt);
     }
 
     context* runtime::execute_pending_job()
     {
+        if (!JS_IsJobPending(rt)) // keeps polling out of the trace
+            return nullptr;
+
+        tracing::span span("job", "qjs.job");
         JSContext* ctx;
         int err = JS_ExecutePendingJob(rt, &ctx);
         if (err == 0) // no job to run
@@ -33,8 +55,27 @@ namespace qjs
         return JS_IsJobPending(rt);
     }
 
+    void runtime::run_gc()
+    {
+        tracing::span span("gc", "qjs.gc");
+        JS_RunGC(rt);
+    }
+
+    void runtime::set_interrupt_handler(interrupt_callback* handler, void* opaque)
+    {
+        m_interrupt_handler = handler;
+        m_interrupt_opaque = opaque;
+        JS_SetInterruptHandler(rt, handler, opaque);
+    }
+
+    runtime* runtime::get(JSRuntime* rt)
+    {
+        return static_cast<runtime*>(JS_GetRuntimeOpaque(rt));
+    }
+
     JSModuleDef* runtime::module_loader(JSContext* ctx, const char* module_name, void* opaque)
     {
+        tracing::span span("load module", "qjs.module", module_name);
         context::module_data data;
         context& context = context::get(ctx);
 
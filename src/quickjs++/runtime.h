@@ -1,14 +1,26 @@
 #pragma once
 #include "quickjs_fwd.h"
+#include <memory>
+#include <utility>
+
+namespace qjs::detail
+{
+    class allocation_tracker;
+}
 
 namespace qjs
 {
     /** Thin wrapper over JSRuntime* rt.
-     *  Calls JS_FreeRuntime on destruction. noncopyable.
+     *  Calls JS_SetRuntimeOpaque(rt, this); on construction and JS_FreeRuntime on destruction. noncopyable.
+     *  SharedArrayBuffers are allocated by shared_buffer, so they can be shared with other runtimes.
+     *  If allocations::enabled(), the runtime's memory is accounted through allocations::snapshot.
      */
     class runtime
     {
     public:
+        /** Handler the engine polls while running JS, see JS_SetInterruptHandler. Returning non-zero interrupts the script. */
+        using interrupt_callback = int(JSRuntime* rt, void* opaque);
+
         JSRuntime* rt;
 
         runtime();
@@ -20,7 +32,32 @@ namespace qjs
         context* execute_pending_job();
 
         bool is_job_pending() const;
+
+        /** Run a full garbage collection cycle (JS_RunGC), traced as a "gc" span. */
+        void run_gc();
+
+        /** Queue through which other threads hand jobs back to this runtime's thread.
+         *  The queue outlives the runtime for as long as a thread holds it, but accepts no jobs after that.
+         */
+        std::shared_ptr<completion_queue> completions() const { return m_completions; }
+
+        /** Install an interrupt handler, remembering it so that tools like profiler can chain to it and restore it. */
+        void set_interrupt_handler(interrupt_callback* handler, void* opaque);
+
+        /** Handler and opaque installed through set_interrupt_handler, or nullptrs. */
+        std::pair<interrupt_callback*, void*> interrupt_handler() const noexcept { return { m_interrupt_handler, m_interrupt_opaque }; }
+
+        /** Allocator accounting this runtime's memory, or nullptr if allocations weren't enabled at its creation. */
+        detail::allocation_tracker* allocation_tracker() const { return m_allocations.get(); }
+
+        /** Get qjs::runtime from JSRuntime opaque pointer, or nullptr if rt wasn't created by qjs::runtime. */
+        static runtime* get(JSRuntime* rt);
     private:
+        std::unique_ptr<detail::allocation_tracker> m_allocations;
+        std::shared_ptr<completion_queue> m_completions;
+        interrupt_callback* m_interrupt_handler = nullptr;
+        void* m_interrupt_opaque = nullptr;
+
         static JSModuleDef* module_loader(JSContext* ctx, const char* module_name, void* opaque);
         static void promise_rejection_tracker(
             JSContext* ctx, JSValueConst promise, JSValueConst reason, bool is_handled, void* opaque);
@@ -0,0 +1,287 @@
+#include "runtime_pool.h"
+#include "completion_queue.h"
+#include "event_loop.h"
+#include <deque>
+
+namespace qjs
+{
+    struct runtime_pool::worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void(context&)>> jobs;
+        std::thread thread;
+
+        // set on the worker's own thread while it runs
+        context* ctx = nullptr;
+        event_loop* loop = nullptr;
+        std::unordered_map<std::string, value> modules;
+        std::optional<value> importer;
+
+        // set before the worker reports ready; polling is guarded by m_sleep_mutex
+        std::shared_ptr<completion_queue> completions;
+        bool polling = false;
+    };
+
+    namespace
+    {
+        thread_local runtime_pool* current_pool = nullptr;
+        thread_local std::size_t current_worker = 0;
+
+        /** Run one iteration of a worker's event loop outside of any job.
+         *  Errors thrown by timer and watcher callbacks there have no job to report to, so they are dropped,
+         *  like packaged_task does for jobs, instead of ending the worker.
+         */
+        void run_loop_once(event_loop& loop, std::optional<event_loop::clock::duration> max_wait)
+        {
+            try
+            {
+                loop.run_once(max_wait);
+            }
+            catch (...)
+            {
+            }
+        }
+
+        /** Calls a function when leaving a scope, however it is left. */
+        template<typename F>
+        struct scope_exit
+        {
+            F f;
+            ~scope_exit() { f(); }
+        };
+    }
+
+    runtime_pool::runtime_pool(std::size_t size, initializer init)
+    {
+        std::vector<std::promise<void>> ready(std::max<std::size_t>(size, 1));
+        for (std::size_t i = 0; i < ready.size(); ++i)
+            m_workers.push_back(std::make_unique<worker>());
+        for (std::size_t i = 0; i < ready.size(); ++i)
+            m_workers[i]->thread = std::thread(&runtime_pool::run, this, i, std::cref(init), std::ref(ready[i]));
+
+        try
+        {
+            for (std::promise<void>& p : ready)
+                p.get_future().get();
+        }
+        catch (...)
+        {
+            stop();
+            throw;
+        }
+    }
+
+    runtime_pool::~runtime_pool()
+    {
+        stop();
+    }
+
+    value runtime_pool::await(value promise)
+    {
+        if (!current_pool)
+            throw std::logic_error("runtime_pool::await called outside of a job");
+
+        worker& self = *current_pool->m_workers[current_worker];
+        while (JS_PromiseState(promise.ctx, promise.v) == JS_PROMISE_PENDING)
+        {
+            if (!self.loop->run_once())
+                break;
+        }
+
+        switch (JS_PromiseState(promise.ctx, promise.v))
+        {
+        case JS_PROMISE_NOT_A_PROMISE:
+            return promise;
+        case JS_PROMISE_FULFILLED:
+            return value(promise.ctx, JS_PromiseResult(promise.ctx, promise.v));
+        case JS_PROMISE_REJECTED:
+            JS_Throw(promise.ctx, JS_PromiseResult(promise.ctx, promise.v));
+            throw exception(promise.ctx);
+        default:
+            throw std::runtime_error("Promise can never settle: nothing is left for the event loop to wait for");
+        }
+    }
+
+    value runtime_pool::import_module(const std::string& module)
+    {
+        if (!current_pool)
+            throw std::logic_error("runtime_pool::import_module called outside of a job");
+
+        worker& self = *current_pool->m_workers[current_worker];
+        if (auto it = self.modules.find(module); it != self.modules.end())
+            return it->second;
+
+        // dynamic import is syntax only, so it is reached through a function taking the specifier
+        if (!self.importer)
+            self.importer = self.ctx->eval("(specifier) => import(specifier)", "<runtime_pool>");
+
+        value ns = await(self.importer->as<std::function<value(const std::string&)>>()(module));
+        self.modules.emplace(module, ns);
+        return ns;
+    }
+
+    void runtime_pool::enqueue(std::function<void(context&)> job)
+    {
+        // jobs submitted from a job stay with the submitting worker, unless they get stolen
+        std::size_t target = current_pool == this ? current_worker : m_next.fetch_add(1, std::memory_order_relaxed) % size();
+        {
+            std::lock_guard lock(m_workers[target]->mutex);
+            m_workers[target]->jobs.push_back(std::move(job));
+        }
+
+        {
+            std::lock_guard lock(m_sleep_mutex);
+            m_pending.fetch_add(1);
+            wake_polling();
+        }
+        m_wake.notify_one();
+    }
+
+    void runtime_pool::wake_polling()
+    {
+        // a worker sleeping in its event loop wakes up when something is posted to its runtime's completion queue
+        for (auto& w : m_workers)
+        {
+            if (w->polling)
+            {
+                w->completions->post(w->ctx->ctx, [] {});
+                w->polling = false;
+            }
+        }
+    }
+
+    bool runtime_pool::take(std::size_t self, std::function<void(context&)>& job)
+    {
+        {
+            worker& own = *m_workers[self];
+            std::lock_guard lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = std::move(own.jobs.front());
+                own.jobs.pop_front();
+                return true;
+            }
+        }
+
+        // steal the newest job of another worker, leaving its oldest jobs to it
+        for (std::size_t i = 1; i < size(); ++i)
+        {
+            worker& victim = *m_workers[(self + i) % size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = std::move(victim.jobs.back());
+                victim.jobs.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void runtime_pool::run(std::size_t self, const initializer& init, std::promise<void>& ready)
+    {
+        worker& w = *m_workers[self];
+        bool started = false;
+        try
+        {
+            runtime rt;
+            context ctx(rt);
+            event_loop loop(rt);
+
+            // detach the worker before its context and runtime are destroyed, even if the worker fails,
+            // so that enqueue and stop never reach them and JS values are freed before their runtime
+            scope_exit detach{[&] {
+                {
+                    std::lock_guard lock(m_sleep_mutex);
+                    w.polling = false;
+                    w.ctx = nullptr;
+                    w.loop = nullptr;
+                }
+                w.modules.clear();
+                w.importer.reset();
+            }};
+
+            loop.install(ctx);
+            if (init)
+                init(rt, ctx);
+
+            w.ctx = &ctx;
+            w.loop = &loop;
+            w.completions = rt.completions();
+            current_pool = this;
+            current_worker = self;
+            ready.set_value();
+            started = true;
+
+            std::function<void(context&)> job;
+            while (true)
+            {
+                if (take(self, job))
+                {
+                    m_pending.fetch_sub(1);
+                    job(ctx);
+                    job = nullptr;
+
+                    // promise jobs, due timers and ready fds left behind by the job run before the next one
+                    run_loop_once(loop, event_loop::clock::duration::zero());
+                    continue;
+                }
+
+                std::unique_lock lock(m_sleep_mutex);
+                if (m_pending.load() > 0)
+                    continue;
+                if (m_stopping)
+                    break;
+
+                if (!loop.alive())
+                {
+                    m_wake.wait(lock, [this] { return m_stopping || m_pending.load() > 0; });
+                    continue;
+                }
+
+                // timers or watchers are left, so sleep in the event loop until they fire or enqueue wakes us
+                w.polling = true;
+                lock.unlock();
+                run_loop_once(loop, std::nullopt);
+                lock.lock();
+                w.polling = false;
+            }
+        }
+        catch (...)
+        {
+            // jobs can't throw, since packaged_task catches everything, so this is a failed initialization
+            if (!started)
+                ready.set_exception(std::current_exception());
+        }
+    }
+
+    void runtime_pool::stop()
+    {
+        {
+            std::lock_guard lock(m_sleep_mutex);
+            m_stopping = true;
+            wake_polling();
+        }
+        m_wake.notify_all();
+
+        for (auto& w : m_workers)
+        {
+            if (w->thread.joinable())
+                w->thread.join();
+        }
+    }
+
+    std::string runtime_pool::describe(const exception& ex)
+    {
+        value error = ex.get_value();
+        std::string message = error.as<std::string>();
+        if (JS_IsError(error.v))
+        {
+            value stack = error["stack"];
+            if (JS_IsString(stack.v))
+                message += '\n' + stack.as<std::string>();
+        }
+        return message;
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "context.h"
+#include "runtime.h"
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace qjs
+{
+    /** A fixed set of isolated runtimes, one per thread, behind a single job submission API.
+     *  Each worker owns a runtime, a context and an event_loop installed into it. Jobs are pushed
+     *  to per-worker deques (round robin, or the submitting worker's own deque when submitted from a job)
+     *  and idle workers steal from the back of other workers' deques, so one slow job doesn't hold up the rest.
+     *  Between jobs and while idle, workers keep running their event loop, so timers and fd watchers set up
+     *  by a job fire after it returns; errors thrown by their callbacks outside of a job are dropped.
+     *  Results come back as futures. JS exceptions are converted to std::runtime_error, since qjs::exception
+     *  refers to a context that the receiving thread may not touch. JS values never leave their worker.
+     *  Example:
+     *  qjs::runtime_pool pool(4, [](qjs::runtime&, qjs::context& ctx) { ctx.add_module("native").add("f", f); });
+     *  std::future<int> result = pool.call<int>("./handlers.js", "handle", 42);
+     */
+    class runtime_pool
+    {
+    public:
+        /** Sets up the runtime and context of a worker, e.g. adds modules. Called on each worker's thread. */
+        using initializer = std::function<void(runtime&, context&)>;
+
+        /** Start `size` workers and wait until all of them are initialized.
+         *  @throws The exception thrown by `init` on any worker, after stopping all of them.
+         */
+        explicit runtime_pool(std::size_t size = std::max(1u, std::thread::hardware_concurrency()), initializer init = nullptr);
+        runtime_pool(const runtime_pool&) = delete;
+
+        /** Finish all submitted jobs, then stop the workers. */
+        ~runtime_pool();
+
+        std::size_t size() const noexcept { return m_workers.size(); }
+
+        /** Run `f` with the context of some worker.
+         *  @return Future of the result of `f`, which must not be a JS value.
+         */
+        template<typename F> requires std::invocable<F&, context&>
+        auto submit(F&& f) -> std::future<std::invoke_result_t<F&, context&>>
+        {
+            using R = std::invoke_result_t<F&, context&>;
+            static_assert(!std::same_as<std::decay_t<R>, value>, "JS values can't leave the runtime they belong to");
+
+            auto task = std::make_shared<std::packaged_task<R(context&)>>([f = std::forward<F>(f)](context& ctx) mutable -> R {
+                try
+                {
+                    return f(ctx);
+                }
+                catch (const exception& ex)
+                {
+                    throw std::runtime_error(describe(ex));
+                }
+            });
+
+            std::future<R> result = task->get_future();
+            enqueue([task](context& ctx) { (*task)(ctx); });
+            return result;
+        }
+
+        /** Evaluate a script on some worker, wait for the result if it is a promise and convert it to R. */
+        template<typename R = void>
+        std::future<R> eval(std::string source, std::string filename = "<eval>", int flags = 0)
+        {
+            return submit([source = std::move(source), filename = std::move(filename), flags](context& ctx) -> R {
+                value result = await(ctx.eval(source, filename.c_str(), flags));
+                if constexpr (!std::is_void_v<R>)
+                    return result.as<R>();
+            });
+        }
+
+        /** Call an export of a module on some worker, wait for the result if it is a promise and convert it to R.
+         *  Modules are resolved by the context's module_loader and imported once per worker.
+         */
+        template<typename R = void, typename... Args>
+        std::future<R> call(std::string module, std::string name, Args&&... args)
+        {
+            return submit([module = std::move(module), name = std::move(name),
+                           args = std::make_tuple(std::decay_t<Args>(std::forward<Args>(args))...)](context& ctx) -> R {
+                value function = import_module(module)[name.c_str()];
+                value result = await(std::apply(function.as<std::function<value(std::decay_t<Args>...)>>(), args));
+                if constexpr (!std::is_void_v<R>)
+                    return result.as<R>();
+            });
+        }
+
+        /** Wait for a promise created in the current job, running the worker's event loop meanwhile.
+         *  Only callable from inside a job. Returns non-promise values as they are.
+         *  @throws exception if the promise is rejected, std::runtime_error if it can never settle.
+         */
+        static value await(value promise);
+
+        /** Import a module in the current worker's context and return its namespace. Only callable from inside a job. */
+        static value import_module(const std::string& module);
+    private:
+        struct worker;
+
+        std::vector<std::unique_ptr<worker>> m_workers;
+        std::atomic<std::size_t> m_next { 0 };
+
+        std::mutex m_sleep_mutex;
+        std::condition_variable m_wake;
+        std::atomic<std::size_t> m_pending { 0 };
+        bool m_stopping = false;
+
+        void enqueue(std::function<void(context&)> job);
+        void wake_polling();
+        bool take(std::size_t self, std::function<void(context&)>& job);
+        void run(std::size_t self, const initializer& init, std::promise<void>& ready);
+        void stop();
+
+        static std::string describe(const exception& ex);
+    };
+}
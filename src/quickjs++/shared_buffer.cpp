@@ -0,0 +1,233 @@
+#include "shared_buffer.h"
+#include "context.h"
+#include "internal.h"
+#include "runtime.h"
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace qjs
+{
+    namespace
+    {
+        constexpr uint32_t block_magic = 0x51534142; // "QSAB"
+
+        /** Bookkeeping stored right before the data of every shared buffer. */
+        struct alignas(64) block_header
+        {
+            std::atomic<std::size_t> refs;
+            std::size_t size;
+            void* mapping; // start of the memory mapping, or nullptr if allocated with operator new
+            std::size_t mapping_size;
+            uint32_t magic;
+        };
+
+        block_header* header_of(uint8_t* data) noexcept
+        {
+            return reinterpret_cast<block_header*>(data - sizeof(block_header));
+        }
+
+        uint8_t* new_block(std::size_t size, void* mapping, std::size_t mapping_size, uint8_t* data) noexcept
+        {
+            new (header_of(data)) block_header { { 1 }, size, mapping, mapping_size, block_magic };
+            return data;
+        }
+
+        void dup_block(uint8_t* data) noexcept
+        {
+            header_of(data)->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void free_block(uint8_t* data) noexcept
+        {
+            block_header* header = header_of(data);
+            if (header->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            header->magic = 0;
+            #ifndef _WIN32
+            if (header->mapping)
+            {
+                munmap(header->mapping, header->mapping_size);
+                return;
+            }
+            #endif
+            ::operator delete(header, std::align_val_t(alignof(block_header)));
+        }
+
+        uint8_t* allocate_block(std::size_t size)
+        {
+            auto header = static_cast<uint8_t*>(::operator new(sizeof(block_header) + size, std::align_val_t(alignof(block_header))));
+            std::memset(header + sizeof(block_header), 0, size);
+            return new_block(size, nullptr, 0, header + sizeof(block_header));
+        }
+
+        #ifndef _WIN32
+        /** Maps a header page followed by `size` bytes; the header is placed at the end of the first page. */
+        uint8_t* map_block(std::size_t size, int fd)
+        {
+            std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+            std::size_t mapping_size = page + std::max<std::size_t>(size, 1);
+
+            void* mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED)
+                throw std::bad_alloc();
+
+            uint8_t* data = static_cast<uint8_t*>(mapping) + page;
+            if (fd >= 0 && size > 0 &&
+                mmap(data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+            {
+                munmap(mapping, mapping_size);
+                throw std::runtime_error("Cannot map file");
+            }
+
+            return new_block(size, mapping, mapping_size, data);
+        }
+        #endif
+    }
+
+    const JSSharedArrayBufferFunctions shared_buffer::functions {
+        .sab_alloc = [](void*, std::size_t size) -> void* {
+            try
+            {
+                return allocate_block(size);
+            }
+            catch (...)
+            {
+                return nullptr;
+            }
+        },
+        .sab_free = [](void*, void* ptr) { free_block(static_cast<uint8_t*>(ptr)); },
+        .sab_dup = [](void*, void* ptr) { dup_block(static_cast<uint8_t*>(ptr)); },
+        .sab_opaque = nullptr
+    };
+
+    shared_buffer::shared_buffer(const shared_buffer& other) noexcept : m_data(other.m_data)
+    {
+        if (m_data)
+            dup_block(m_data);
+    }
+
+    shared_buffer::shared_buffer(shared_buffer&& other) noexcept : m_data(std::exchange(other.m_data, nullptr)) {}
+
+    shared_buffer::~shared_buffer()
+    {
+        if (m_data)
+            free_block(m_data);
+    }
+
+    shared_buffer& shared_buffer::operator=(shared_buffer other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        return *this;
+    }
+
+    shared_buffer shared_buffer::allocate(std::size_t size, bool mapped)
+    {
+        #ifndef _WIN32
+        if (mapped)
+            return shared_buffer(map_block(size, -1));
+        #endif
+        return shared_buffer(allocate_block(size));
+    }
+
+    shared_buffer shared_buffer::map_file(const std::filesystem::path& path)
+    {
+        #ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open " + path.string());
+
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+        {
+            close(fd);
+            throw std::runtime_error("Cannot stat " + path.string());
+        }
+
+        try
+        {
+            shared_buffer result(map_block(static_cast<std::size_t>(st.st_size), fd));
+            close(fd);
+            return result;
+        }
+        catch (...)
+        {
+            close(fd);
+            throw;
+        }
+        #else
+        std::optional<std::string> contents = detail::read_file(path);
+        if (!contents)
+            throw std::runtime_error("Cannot open " + path.string());
+
+        shared_buffer result(allocate_block(contents->size()));
+        std::memcpy(result.data(), contents->data(), contents->size());
+        return result;
+        #endif
+    }
+
+    shared_buffer shared_buffer::from_data(uint8_t* data) noexcept
+    {
+        if (!data || header_of(data)->magic != block_magic)
+            return shared_buffer();
+        dup_block(data);
+        return shared_buffer(data);
+    }
+
+    std::size_t shared_buffer::size() const noexcept
+    {
+        return m_data ? header_of(m_data)->size : 0;
+    }
+
+    namespace
+    {
+        /** Class id of SharedArrayBuffer objects, taken from a buffer made through the C API. */
+        JSClassID shared_array_buffer_class(JSContext* ctx)
+        {
+            return detail::builtin_class_id(ctx, [](JSContext* fresh) {
+                return js_traits<shared_buffer>::wrap(fresh, shared_buffer::allocate(0));
+            });
+        }
+    }
+
+    shared_buffer js_traits<shared_buffer>::unwrap(JSContext* ctx, JSValueConst val)
+    {
+        // buffers of other runtimes may come from the default allocator, with no header in front of their data
+        if (!runtime::get(JS_GetRuntime(ctx)))
+        {
+            JS_ThrowTypeError(ctx, "SharedArrayBuffers can only be unwrapped in a qjs::runtime");
+            throw exception(ctx);
+        }
+
+        // compare class ids rather than prototypes: script can make any object an instance of SharedArrayBuffer
+        std::size_t size;
+        bool is_shared = JS_IsObject(val) && JS_GetClassID(val) == shared_array_buffer_class(ctx);
+        uint8_t* data = is_shared ? JS_GetArrayBuffer(ctx, &size, val) : nullptr;
+        shared_buffer result = shared_buffer::from_data(data);
+        if (!result)
+        {
+            JS_ThrowTypeError(ctx, "Expected a SharedArrayBuffer");
+            throw exception(ctx);
+        }
+        return result;
+    }
+
+    JSValue js_traits<shared_buffer>::wrap(JSContext* ctx, const shared_buffer& val) noexcept
+    {
+        if (!runtime::get(JS_GetRuntime(ctx)))
+            return JS_ThrowTypeError(ctx, "SharedArrayBuffers can only be wrapped in a qjs::runtime");
+        if (!val)
+            return JS_NULL;
+
+        // the engine takes its own reference through sab_dup and drops it through sab_free
+        return JS_NewArrayBuffer(ctx, val.data(), val.size(), nullptr, nullptr, true);
+    }
+}
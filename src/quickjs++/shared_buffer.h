@@ -0,0 +1,63 @@
+#pragma once
+#include "js_traits.h"
+#include <filesystem>
+
+namespace qjs
+{
+    /** Refcounted memory that backs SharedArrayBuffers in any number of runtimes of this process.
+     *  Every qjs::runtime allocates its SharedArrayBuffers through shared_buffer::functions, so buffers created
+     *  in JS can also be handed to other runtimes, e.g. inside a qjs::message, without copying.
+     *  Converting a shared_buffer to JS creates a SharedArrayBuffer over the same memory; use Atomics
+     *  for synchronization between runtimes. The memory is freed when the last handle and buffer are gone.
+     *  Example:
+     *  qjs::shared_buffer dataset = qjs::shared_buffer::map_file("dataset.bin");
+     *  for (auto& ctx : contexts)
+     *      ctx.global()["dataset"] = dataset;
+     */
+    class shared_buffer
+    {
+    public:
+        /** Allocator hooks installed into every qjs::runtime with JS_SetSharedArrayBufferFunctions. */
+        static const JSSharedArrayBufferFunctions functions;
+
+        shared_buffer() noexcept = default;
+        shared_buffer(const shared_buffer& other) noexcept;
+        shared_buffer(shared_buffer&& other) noexcept;
+        ~shared_buffer();
+
+        shared_buffer& operator=(shared_buffer other) noexcept;
+
+        /** Allocate `size` zeroed bytes.
+         *  @param mapped Use an anonymous memory mapping, committed lazily by the OS. Suits large buffers.
+         */
+        static shared_buffer allocate(std::size_t size, bool mapped = false);
+
+        /** Map a file into memory as a private (copy-on-write) mapping.
+         *  Pages are read from the file on first access and stay shared with the page cache until written to.
+         */
+        static shared_buffer map_file(const std::filesystem::path& path);
+
+        /** Take a new reference to memory that was allocated by shared_buffer, e.g. a SharedArrayBuffer's data.
+         *  @return An empty buffer if `data` wasn't allocated by shared_buffer.
+         */
+        static shared_buffer from_data(uint8_t* data) noexcept;
+
+        uint8_t* data() const noexcept { return m_data; }
+        std::size_t size() const noexcept;
+        explicit operator bool() const noexcept { return m_data; }
+    private:
+        uint8_t* m_data = nullptr;
+
+        explicit shared_buffer(uint8_t* data) noexcept : m_data(data) {}
+    };
+
+    /** Conversion traits for shared_buffer <-> SharedArrayBuffer.
+     *  Only SharedArrayBuffers of a qjs::runtime can be unwrapped, since only those are allocated by shared_buffer.
+     */
+    template<>
+    struct js_traits<shared_buffer>
+    {
+        static shared_buffer unwrap(JSContext* ctx, JSValueConst val);
+        static JSValue wrap(JSContext* ctx, const shared_buffer& val) noexcept;
+    };
+}
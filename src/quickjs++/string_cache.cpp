@@ -0,0 +1,50 @@
+#include "string_cache.h"
+#include "context.h"
+#include <cstring>
+
+namespace qjs::detail
+{
+    string_cache::~string_cache()
+    {
+        for (slot& s : m_slots)
+            JS_FreeValue(m_ctx, s.value);
+    }
+
+    JSValue string_cache::get(std::string_view str) noexcept
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : str)
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+
+        slot& s = m_slots[(hash ^ (hash >> 32)) % slot_count];
+        if (!JS_IsUndefined(s.value) && s.length == str.size() && std::memcmp(s.data, str.data(), str.size()) == 0)
+            return JS_DupValue(m_ctx, s.value);
+
+        JSValue value = JS_NewStringLen(m_ctx, str.data(), str.size());
+        if (JS_IsException(value))
+            return value;
+
+        JS_FreeValue(m_ctx, s.value);
+        s.value = JS_DupValue(m_ctx, value);
+        s.length = static_cast<uint8_t>(str.size());
+        std::memcpy(s.data, str.data(), str.size());
+        return value;
+    }
+
+    JSValue new_cached_string(JSContext* ctx, std::string_view str) noexcept
+    {
+        auto owner = static_cast<context*>(JS_GetContextOpaque(ctx));
+        if (!owner)
+            return JS_NewStringLen(ctx, str.data(), str.size());
+
+        try
+        {
+            return owner->strings().get(str);
+        }
+        catch (...) // the cache couldn't be allocated
+        {
+            return JS_NewStringLen(ctx, str.data(), str.size());
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <quickjs/quickjs.h>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace qjs::detail
+{
+    /** Per-context cache of JS strings created from short C++ strings, so that converting the same short
+     *  strings over and over (keys, tags, enum names in templating) reuses one JS string instead of allocating.
+     *  Direct-mapped by hash: a string evicts whatever shared its slot. Strings live until evicted or until the
+     *  context is destroyed. JS strings are immutable, so sharing them is invisible to scripts.
+     */
+    class string_cache
+    {
+    public:
+        /// Longer strings are rarely repeated and cost more to hash and compare than to allocate.
+        static constexpr std::size_t max_length = 32;
+        static constexpr std::size_t slot_count = 256;
+
+        explicit string_cache(JSContext* ctx) : m_ctx(ctx) {}
+        string_cache(const string_cache&) = delete;
+
+        ~string_cache();
+
+        /** Returns a new reference to the JS string of str, or JS_EXCEPTION. str must be at most max_length long. */
+        JSValue get(std::string_view str) noexcept;
+    private:
+        struct slot
+        {
+            JSValue value = JS_UNDEFINED;
+            uint8_t length = 0;
+            char data[max_length];
+        };
+
+        JSContext* m_ctx;
+        std::array<slot, slot_count> m_slots;
+    };
+
+    /** JS string of str, taken from the cache of the qjs::context owning ctx if str is short. */
+    JSValue new_cached_string(JSContext* ctx, std::string_view str) noexcept;
+
+    /** Creates a JS string from UTF-8, going through the context's string_cache for short strings. */
+    inline JSValue new_string(JSContext* ctx, std::string_view str) noexcept
+    {
+        if (str.size() <= string_cache::max_length)
+            return new_cached_string(ctx, str);
+        return JS_NewStringLen(ctx, str.data(), str.size());
+    }
+}
@@ -0,0 +1,176 @@
+#include "tracing.h"
+#include "internal.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace qjs::tracing
+{
+    namespace
+    {
+        struct event
+        {
+            const char* name;
+            const char* category;
+            std::string detail;
+            span::clock::time_point start;
+            span::clock::duration duration;
+        };
+
+        /** Ring buffer of one thread. Its mutex is only contended while the trace is exported or cleared. */
+        struct thread_buffer
+        {
+            std::mutex mutex;
+            std::vector<event> events;
+            std::size_t next = 0;
+            bool wrapped = false;
+            uint64_t tid;
+        };
+
+        struct registry
+        {
+            std::atomic<bool> enabled { false };
+            std::atomic<std::size_t> capacity { 1 << 16 };
+            span::clock::time_point epoch = span::clock::now();
+
+            std::mutex mutex;
+            std::vector<std::shared_ptr<thread_buffer>> buffers;
+        };
+
+        registry& get_registry()
+        {
+            static registry* instance = new registry; // leaked, so spans can end during static destruction
+            return *instance;
+        }
+
+        thread_buffer& current_buffer()
+        {
+            // the registry keeps buffers of finished threads, so their events can still be exported
+            thread_local std::shared_ptr<thread_buffer> buffer = [] {
+                registry& r = get_registry();
+                auto b = std::make_shared<thread_buffer>();
+                std::lock_guard lock(r.mutex);
+                b->tid = r.buffers.size() + 1;
+                r.buffers.push_back(b);
+                return b;
+            }();
+            return *buffer;
+        }
+    }
+
+    void enable(std::size_t capacity)
+    {
+        registry& r = get_registry();
+        r.capacity.store(std::max<std::size_t>(capacity, 1), std::memory_order_relaxed);
+        r.enabled.store(true, std::memory_order_release);
+    }
+
+    void disable() noexcept
+    {
+        get_registry().enabled.store(false, std::memory_order_relaxed);
+    }
+
+    bool enabled() noexcept
+    {
+        return get_registry().enabled.load(std::memory_order_relaxed);
+    }
+
+    void write_chrome_trace(std::ostream& out)
+    {
+        registry& r = get_registry();
+        std::lock_guard lock(r.mutex);
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (const auto& buffer : r.buffers)
+        {
+            std::lock_guard buffer_lock(buffer->mutex);
+            std::size_t count = buffer->wrapped ? buffer->events.size() : buffer->next;
+            std::size_t begin = buffer->wrapped ? buffer->next : 0;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const event& e = buffer->events[(begin + i) % buffer->events.size()];
+                auto us = [](span::clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+
+                out << (first ? "" : ",") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid << ",\"name\":";
+                detail::write_json_string(out, e.name);
+                out << ",\"cat\":";
+                detail::write_json_string(out, e.category);
+                out << ",\"ts\":" << us(e.start - r.epoch) << ",\"dur\":" << us(e.duration);
+                if (!e.detail.empty())
+                {
+                    out << ",\"args\":{\"detail\":";
+                    detail::write_json_string(out, e.detail);
+                    out << '}';
+                }
+                out << '}';
+                first = false;
+            }
+        }
+        out << "]}";
+    }
+
+    void clear()
+    {
+        registry& r = get_registry();
+        std::lock_guard lock(r.mutex);
+        for (const auto& buffer : r.buffers)
+        {
+            std::lock_guard buffer_lock(buffer->mutex);
+            buffer->events.clear();
+            buffer->next = 0;
+            buffer->wrapped = false;
+        }
+    }
+
+    void span::begin(const char* name, const char* category, std::string_view detail) noexcept
+    {
+        try
+        {
+            m_detail = detail;
+        }
+        catch (...)
+        {
+            return;
+        }
+
+        m_name = name;
+        m_category = category;
+        m_start = clock::now();
+    }
+
+    void span::end() noexcept
+    {
+        clock::duration duration = clock::now() - m_start;
+        try
+        {
+            thread_buffer& buffer = current_buffer();
+            std::size_t capacity = get_registry().capacity.load(std::memory_order_relaxed);
+
+            std::lock_guard lock(buffer.mutex);
+            event e { m_name, m_category, std::move(m_detail), m_start, duration };
+            if (!buffer.wrapped && buffer.events.size() < capacity)
+            {
+                buffer.events.push_back(std::move(e));
+                buffer.next = buffer.events.size();
+            }
+            else
+            {
+                if (!buffer.wrapped) // full, or the capacity was lowered since
+                {
+                    buffer.wrapped = true;
+                    buffer.next = 0;
+                }
+                buffer.events[buffer.next] = std::move(e);
+                buffer.next = (buffer.next + 1) % buffer.events.size();
+            }
+        }
+        catch (...)
+        {
+            // tracing must never make the traced code fail
+        }
+    }
+}
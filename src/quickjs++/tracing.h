@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace qjs
+{
+    /** Process-wide trace of where time goes: script evaluation, module loading, pending jobs and GC.
+     *  Spans are recorded into per-thread ring buffers, which keep the most recent events, and exported in
+     *  Chrome trace event format (chrome://tracing, Perfetto, speedscope). Disabled by default; while disabled
+     *  a span costs one atomic load. Applications can record their own spans with tracing::span.
+     *  Example:
+     *  qjs::tracing::enable();
+     *  ... // startup, requests
+     *  qjs::tracing::write_chrome_trace(std::ofstream("trace.json"));
+     */
+    namespace tracing
+    {
+        /** Start recording.
+         *  @param capacity Number of events kept per thread; older events are overwritten.
+         */
+        void enable(std::size_t capacity = 1 << 16);
+
+        /** Stop recording. Recorded events are kept. */
+        void disable() noexcept;
+
+        bool enabled() noexcept;
+
+        /** Write all recorded events as a Chrome trace JSON object. */
+        void write_chrome_trace(std::ostream& out);
+
+        /** Discard all recorded events. */
+        void clear();
+
+        /** Records the time between its construction and destruction as a complete ("X") event. */
+        class span
+        {
+        public:
+            using clock = std::chrono::steady_clock;
+
+            /** @param name, category Must be string literals or otherwise outlive the trace.
+             *  @param detail Shown as the "detail" argument of the event, e.g. a file name.
+             */
+            explicit span(const char* name, const char* category = "qjs", std::string_view detail = {}) noexcept
+            {
+                if (enabled())
+                    begin(name, category, detail);
+            }
+
+            span(const span&) = delete;
+
+            ~span()
+            {
+                if (m_name)
+                    end();
+            }
+        private:
+            const char* m_name = nullptr;
+            const char* m_category = nullptr;
+            std::string m_detail;
+            clock::time_point m_start;
+
+            void begin(const char* name, const char* category, std::string_view detail) noexcept;
+            void end() noexcept;
+        };
+    }
+}
@@ -0,0 +1,468 @@
+#include "unicode.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define QUICKJSPP_X86_64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define QUICKJSPP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define QUICKJSPP_TARGET_AVX2
+#endif
+
+namespace qjs::unicode
+{
+    namespace
+    {
+        struct kernels
+        {
+            simd_level level;
+            std::size_t (*ascii_length)(const char* str, std::size_t length) noexcept;
+            std::size_t (*ascii_length16)(const char16_t* str, std::size_t length) noexcept;
+            bool (*is_valid_utf8)(const char* str, std::size_t length) noexcept;
+            void (*widen)(const char* str, std::size_t length, char16_t* out) noexcept;
+            void (*narrow)(const char16_t* str, std::size_t length, char* out) noexcept;
+        };
+
+        // scalar
+
+        std::size_t ascii_length_scalar(const char* str, std::size_t length) noexcept
+        {
+            std::size_t i = 0;
+            for (; i + 8 <= length; i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, str + i, sizeof(word));
+                if (word & 0x8080808080808080ull)
+                    break;
+            }
+            while (i < length && static_cast<unsigned char>(str[i]) < 0x80)
+                ++i;
+            return i;
+        }
+
+        std::size_t ascii_length16_scalar(const char16_t* str, std::size_t length) noexcept
+        {
+            std::size_t i = 0;
+            while (i < length && str[i] < 0x80)
+                ++i;
+            return i;
+        }
+
+        /** Length of the well-formed multi-byte sequence at str, or 0. */
+        std::size_t utf8_sequence_length(const unsigned char* str, std::size_t length) noexcept
+        {
+            auto in = [&](std::size_t i, unsigned char lo, unsigned char hi) { return i < length && str[i] >= lo && str[i] <= hi; };
+            unsigned char c = str[0];
+            if (c < 0xc2) // continuation bytes, and overlong 2-byte forms
+                return 0;
+            if (c < 0xe0)
+                return in(1, 0x80, 0xbf) ? 2 : 0;
+            if (c < 0xf0)
+            {
+                unsigned char lo = c == 0xe0 ? 0xa0 : 0x80; // overlong
+                unsigned char hi = c == 0xed ? 0x9f : 0xbf; // surrogates
+                return in(1, lo, hi) && in(2, 0x80, 0xbf) ? 3 : 0;
+            }
+            if (c < 0xf5)
+            {
+                unsigned char lo = c == 0xf0 ? 0x90 : 0x80; // overlong
+                unsigned char hi = c == 0xf4 ? 0x8f : 0xbf; // above U+10FFFF
+                return in(1, lo, hi) && in(2, 0x80, 0xbf) && in(3, 0x80, 0xbf) ? 4 : 0;
+            }
+            return 0;
+        }
+
+        /** Validates with `skip_ascii` jumping over long ASCII runs and multi-byte sequences checked one at a time. */
+        template<std::size_t (*skip_ascii)(const char*, std::size_t) noexcept>
+        bool is_valid_utf8_skipping(const char* str, std::size_t length) noexcept
+        {
+            auto bytes = reinterpret_cast<const unsigned char*>(str);
+            std::size_t i = 0;
+            for (;;)
+            {
+                // short runs between multi-byte characters, like spaces, aren't worth a vector scan
+                std::size_t short_run = std::min<std::size_t>(i + 16, length);
+                while (i < short_run && bytes[i] < 0x80)
+                    ++i;
+                if (i == short_run)
+                    i += skip_ascii(str + i, length - i);
+                if (i == length)
+                    return true;
+                if (bytes[i] < 0x80)
+                    continue;
+                std::size_t sequence = utf8_sequence_length(bytes + i, length - i);
+                if (sequence == 0)
+                    return false;
+                i += sequence;
+            }
+        }
+
+        void widen_scalar(const char* str, std::size_t length, char16_t* out) noexcept
+        {
+            for (std::size_t i = 0; i < length; ++i)
+                out[i] = static_cast<unsigned char>(str[i]);
+        }
+
+        void narrow_scalar(const char16_t* str, std::size_t length, char* out) noexcept
+        {
+            for (std::size_t i = 0; i < length; ++i)
+                out[i] = static_cast<char>(str[i]);
+        }
+
+        constexpr kernels scalar_kernels = {
+            simd_level::scalar, ascii_length_scalar, ascii_length16_scalar,
+            is_valid_utf8_skipping<ascii_length_scalar>, widen_scalar, narrow_scalar };
+
+#ifdef QUICKJSPP_X86_64
+        // SSE2, part of x86-64
+
+        std::size_t ascii_length_sse2(const char* str, std::size_t length) noexcept
+        {
+            std::size_t i = 0;
+            for (; i + 16 <= length; i += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+                if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(v)))
+                    return i + std::countr_zero(mask);
+            }
+            return i + ascii_length_scalar(str + i, length - i);
+        }
+
+        std::size_t ascii_length16_sse2(const char16_t* str, std::size_t length) noexcept
+        {
+            const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xff80));
+            std::size_t i = 0;
+            for (; i + 8 <= length; i += 8)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+                __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(v, non_ascii), _mm_setzero_si128());
+                if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(ascii)); mask != 0xffff)
+                    return i + std::countr_zero(~mask) / 2;
+            }
+            return i + ascii_length16_scalar(str + i, length - i);
+        }
+
+        void widen_sse2(const char* str, std::size_t length, char16_t* out) noexcept
+        {
+            std::size_t i = 0;
+            for (; i + 16 <= length; i += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+            }
+            widen_scalar(str + i, length - i, out + i);
+        }
+
+        void narrow_sse2(const char16_t* str, std::size_t length, char* out) noexcept
+        {
+            std::size_t i = 0;
+            for (; i + 16 <= length; i += 16)
+            {
+                __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+                __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i + 8));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(low, high));
+            }
+            narrow_scalar(str + i, length - i, out + i);
+        }
+
+        constexpr kernels sse2_kernels = {
+            simd_level::sse2, ascii_length_sse2, ascii_length16_sse2,
+            is_valid_utf8_skipping<ascii_length_sse2>, widen_sse2, narrow_sse2 };
+
+        // AVX2, detected at runtime
+
+        QUICKJSPP_TARGET_AVX2
+        std::size_t ascii_length_avx2(const char* str, std::size_t length) noexcept
+        {
+            std::size_t i = 0;
+            for (; i + 32 <= length; i += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+                if (auto mask = static_cast<unsigned>(_mm256_movemask_epi8(v)))
+                    return i + std::countr_zero(mask);
+            }
+            return i + ascii_length_sse2(str + i, length - i);
+        }
+
+        QUICKJSPP_TARGET_AVX2
+        std::size_t ascii_length16_avx2(const char16_t* str, std::size_t length) noexcept
+        {
+            const __m256i non_ascii = _mm256_set1_epi16(static_cast<short>(0xff80));
+            std::size_t i = 0;
+            for (; i + 16 <= length; i += 16)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+                __m256i ascii = _mm256_cmpeq_epi16(_mm256_and_si256(v, non_ascii), _mm256_setzero_si256());
+                if (auto mask = static_cast<unsigned>(_mm256_movemask_epi8(ascii)); mask != 0xffffffff)
+                    return i + std::countr_zero(~mask) / 2;
+            }
+            return i + ascii_length16_sse2(str + i, length - i);
+        }
+
+        QUICKJSPP_TARGET_AVX2
+        void widen_avx2(const char* str, std::size_t length, char16_t* out) noexcept
+        {
+            std::size_t i = 0;
+            for (; i + 16 <= length; i += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cvtepu8_epi16(v));
+            }
+            widen_scalar(str + i, length - i, out + i);
+        }
+
+        QUICKJSPP_TARGET_AVX2
+        void narrow_avx2(const char16_t* str, std::size_t length, char* out) noexcept
+        {
+            std::size_t i = 0;
+            for (; i + 32 <= length; i += 32)
+            {
+                __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+                __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i + 16));
+                // packus interleaves the 128-bit lanes of its operands; put them back in order
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xd8);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+            }
+            narrow_sse2(str + i, length - i, out + i);
+        }
+
+        /** UTF-8 validation by Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+         *  Each byte is classified together with the byte before it by three 16-entry table lookups, on the high
+         *  and low nibbles of the previous byte and the high nibble of this one; a bit left set in the AND of the
+         *  three names an error. 3- and 4-byte sequences are then checked by where continuations must appear.
+         */
+        struct utf8_validator
+        {
+            static constexpr uint8_t too_short = 1 << 0;      // lead byte not followed by a continuation
+            static constexpr uint8_t too_long = 1 << 1;       // ASCII followed by a continuation
+            static constexpr uint8_t overlong_3 = 1 << 2;     // 11100000 100_____
+            static constexpr uint8_t too_large = 1 << 3;      // 11110100 1001____ and above
+            static constexpr uint8_t surrogate = 1 << 4;      // 11101101 101_____
+            static constexpr uint8_t overlong_2 = 1 << 5;     // 1100000_ 10______
+            static constexpr uint8_t too_large_1000 = 1 << 6; // 11110101 1000____ and above
+            static constexpr uint8_t overlong_4 = 1 << 6;     // 11110000 1000____
+            static constexpr uint8_t two_conts = 1 << 7;      // two continuations in a row
+            static constexpr uint8_t carry = too_short | too_long | two_conts;
+
+            static constexpr uint8_t byte_1_high[16] = {
+                too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long, // ASCII
+                two_conts, two_conts, two_conts, two_conts,                                     // continuation
+                too_short | overlong_2,                                                         // 1100____
+                too_short,                                                                      // 1101____
+                too_short | overlong_3 | surrogate,                                             // 1110____
+                too_short | too_large | too_large_1000 | overlong_4 };                          // 1111____
+
+            static constexpr uint8_t byte_1_low[16] = {
+                carry | overlong_3 | overlong_2 | overlong_4, // ____0000
+                carry | overlong_2,                           // ____0001
+                carry, carry,                                 // ____001_
+                carry | too_large,                            // ____0100
+                carry | too_large | too_large_1000,           // ____0101
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000 | surrogate, // ____1101
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000 };
+
+            static constexpr uint8_t byte_2_high[16] = {
+                too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short, // ASCII
+                too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 | overlong_4,            // 1000____
+                too_long | overlong_2 | two_conts | overlong_3 | too_large,                             // 1001____
+                too_long | overlong_2 | two_conts | surrogate | too_large,                              // 101_____
+                too_long | overlong_2 | two_conts | surrogate | too_large,
+                too_short, too_short, too_short, too_short };                                           // lead bytes
+
+            __m256i error;
+            __m256i previous;
+            __m256i previous_incomplete;
+
+            QUICKJSPP_TARGET_AVX2
+            static __m256i table(const uint8_t (&entries)[16])
+            {
+                return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(entries)));
+            }
+
+            QUICKJSPP_TARGET_AVX2
+            void check(__m256i input)
+            {
+                if (_mm256_movemask_epi8(input) == 0)
+                {
+                    // an ASCII block is only an error if the previous block ended in the middle of a sequence
+                    error = _mm256_or_si256(error, previous_incomplete);
+                }
+                else
+                {
+                    const __m256i nibble = _mm256_set1_epi8(0x0f);
+                    __m256i shifted = _mm256_permute2x128_si256(previous, input, 0x21);
+                    __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+                    __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+                    __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+                    __m256i special_cases = _mm256_and_si256(
+                        _mm256_and_si256(
+                            _mm256_shuffle_epi8(table(byte_1_high), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                            _mm256_shuffle_epi8(table(byte_1_low), _mm256_and_si256(prev1, nibble))),
+                        _mm256_shuffle_epi8(table(byte_2_high), _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+
+                    // bytes 2 after a 111_____ lead or 3 after a 1111____ lead must be continuations, and only those
+                    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80)));
+                    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80)));
+                    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+                    error = _mm256_or_si256(error, _mm256_xor_si256(must_continue, special_cases));
+
+                    // a lead byte in the last 3 positions may need continuations from the next block
+                    const __m256i incomplete_max = _mm256_setr_epi8(
+                        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                        static_cast<char>(0xf0 - 1), static_cast<char>(0xe0 - 1), static_cast<char>(0xc0 - 1));
+                    previous_incomplete = _mm256_subs_epu8(input, incomplete_max);
+                }
+                previous = input;
+            }
+        };
+
+        QUICKJSPP_TARGET_AVX2
+        bool is_valid_utf8_avx2(const char* str, std::size_t length) noexcept
+        {
+            utf8_validator validator { _mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256() };
+            std::size_t i = 0;
+            for (; i + 32 <= length; i += 32)
+                validator.check(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i)));
+
+            // the zero padding of the last block makes a truncated sequence at the end fail as too short
+            alignas(32) char tail[32] = {};
+            std::memcpy(tail, str + i, length - i);
+            validator.check(_mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+            return _mm256_testz_si256(validator.error, validator.error);
+        }
+
+        constexpr kernels avx2_kernels = {
+            simd_level::avx2, ascii_length_avx2, ascii_length16_avx2,
+            is_valid_utf8_avx2, widen_avx2, narrow_avx2 };
+
+        bool has_avx2() noexcept
+        {
+        #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_cpu_supports("avx2");
+        #elif defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+            __cpuid(info, 1);
+            bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+            __cpuidex(info, 7, 0);
+            return os_saves_ymm && (info[1] & (1 << 5));
+        #else
+            return false;
+        #endif
+        }
+#endif
+
+        const kernels* kernels_for(simd_level level) noexcept
+        {
+            switch (level)
+            {
+            case simd_level::scalar:
+                return &scalar_kernels;
+        #ifdef QUICKJSPP_X86_64
+            case simd_level::sse2:
+                return &sse2_kernels;
+            case simd_level::avx2:
+                return has_avx2() ? &avx2_kernels : nullptr;
+        #endif
+            default:
+                return nullptr;
+            }
+        }
+
+        const kernels* best_kernels() noexcept
+        {
+            for (simd_level level : { simd_level::avx2, simd_level::sse2 })
+            {
+                if (const kernels* k = kernels_for(level))
+                    return k;
+            }
+            return &scalar_kernels;
+        }
+
+        std::atomic<const kernels*> selected = nullptr;
+
+        const kernels& get_kernels() noexcept
+        {
+            const kernels* k = selected.load(std::memory_order_relaxed);
+            if (!k) // racing threads pick the same kernels
+            {
+                k = best_kernels();
+                selected.store(k, std::memory_order_relaxed);
+            }
+            return *k;
+        }
+    }
+
+    simd_level current_simd_level() noexcept
+    {
+        return get_kernels().level;
+    }
+
+    bool is_supported(simd_level level) noexcept
+    {
+        return kernels_for(level) != nullptr;
+    }
+
+    bool set_simd_level(simd_level level) noexcept
+    {
+        const kernels* k = kernels_for(level);
+        if (!k)
+            return false;
+        selected.store(k, std::memory_order_relaxed);
+        return true;
+    }
+
+    const char* to_string(simd_level level) noexcept
+    {
+        switch (level)
+        {
+        case simd_level::sse2: return "sse2";
+        case simd_level::avx2: return "avx2";
+        default: return "scalar";
+        }
+    }
+
+    std::size_t ascii_length(std::string_view str) noexcept
+    {
+        return get_kernels().ascii_length(str.data(), str.size());
+    }
+
+    std::size_t ascii_length(std::u16string_view str) noexcept
+    {
+        return get_kernels().ascii_length16(str.data(), str.size());
+    }
+
+    bool is_valid_utf8(std::string_view str) noexcept
+    {
+        return get_kernels().is_valid_utf8(str.data(), str.size());
+    }
+
+    void widen(std::string_view str, char16_t* out) noexcept
+    {
+        get_kernels().widen(str.data(), str.size(), out);
+    }
+
+    void narrow(std::u16string_view str, char* out) noexcept
+    {
+        get_kernels().narrow(str.data(), str.size(), out);
+    }
+}
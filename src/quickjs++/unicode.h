@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+/** Vectorized text helpers used where strings cross between C++ and JS.
+ *  The widest instruction set the CPU supports (AVX2, then SSE2 on x86-64) is picked at runtime on first use,
+ *  with a portable scalar fallback everywhere else.
+ */
+namespace qjs::unicode
+{
+    enum class simd_level
+    {
+        scalar,
+        sse2,
+        avx2
+    };
+
+    /** Instruction set the helpers currently use. */
+    simd_level current_simd_level() noexcept;
+
+    /** Whether the CPU and this build support `level`. */
+    bool is_supported(simd_level level) noexcept;
+
+    /** Selects the instruction set to use, e.g. to compare them in benchmarks.
+     *  @return false, changing nothing, if the CPU doesn't support `level`.
+     */
+    bool set_simd_level(simd_level level) noexcept;
+
+    const char* to_string(simd_level level) noexcept;
+
+    /** Length of the leading run of ASCII characters. */
+    std::size_t ascii_length(std::string_view str) noexcept;
+    std::size_t ascii_length(std::u16string_view str) noexcept;
+
+    inline bool is_ascii(std::string_view str) noexcept { return ascii_length(str) == str.size(); }
+    inline bool is_ascii(std::u16string_view str) noexcept { return ascii_length(str) == str.size(); }
+
+    /** Whether str is well-formed UTF-8: no overlong forms, surrogates, code points above U+10FFFF
+     *  or truncated sequences.
+     */
+    bool is_valid_utf8(std::string_view str) noexcept;
+
+    /** Zero-extends each byte of ASCII or Latin-1 text to a UTF-16 code unit. `out` must have room for str.size() units. */
+    void widen(std::string_view str, char16_t* out) noexcept;
+
+    /** Truncates UTF-16 code units below U+0100 to Latin-1 bytes. `out` must have room for str.size() bytes. */
+    void narrow(std::u16string_view str, char* out) noexcept;
+}
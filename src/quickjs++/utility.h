@@ -1,6 +1,8 @@
 #pragma once
 #include "quickjs_fwd.h"
 #include <quickjs/quickjs.h>
+#include <ranges>
+#include <tuple>
 #include <vector>
 
 namespace qjs
@@ -30,6 +32,12 @@ namespace qjs
             std::is_member_function_pointer_v<std::remove_reference_t<F>> ||
             requires { &std::remove_reference_t<F>::operator(); };
 
+        /** Type trait that evaluates to true if `Signature` is a function type T(Args...) and T is constructible from Args. */
+        template<typename Signature, typename T>
+        struct is_constructor_signature : std::false_type {};
+        template<typename T, typename... Args>
+        struct is_constructor_signature<T(Args...), T> : std::bool_constant<std::constructible_from<T, Args...>> {};
+
         /** Slight optimization over JS_GetPropertyStr(ctx, this_obj, "prototype") with a constant atom. */
         inline JSValue get_property_prototype(JSContext* ctx, JSValueConst this_obj)
         {
@@ -37,6 +45,22 @@ namespace qjs
             return JS_GetProperty(ctx, this_obj, prop);
         }
 
+        /** Returns the atom of the well-known symbol `Symbol.iterator`. */
+        inline JSAtom get_symbol_iterator(JSContext* ctx)
+        {
+            static const JSAtom atom = [ctx] {
+                JSValue global = JS_GetGlobalObject(ctx);
+                JSValue symbol = JS_GetPropertyStr(ctx, global, "Symbol");
+                JSValue iterator = JS_GetPropertyStr(ctx, symbol, "iterator");
+                JSAtom result = JS_ValueToAtom(ctx, iterator);
+                JS_FreeValue(ctx, iterator);
+                JS_FreeValue(ctx, symbol);
+                JS_FreeValue(ctx, global);
+                return result;
+            }();
+            return atom;
+        }
+
         /** Slight optimization over JS_Invoke(ctx, this_val, JS_NewAtom(ctx, "then"), 1, func) with a constant atom. */
         inline void invoke_on_then(JSContext* ctx, JSValue this_val, JSValue* func)
         {
@@ -105,6 +129,37 @@ namespace qjs
         const char* name{};
     };
 
+    /** A wrapper type for a set of overloaded callables exposed as a single JS function.
+     *  The first overload whose arity and argument types match the JS arguments is called.
+     *  @tparam PassThis If true, passes JavaScript "this" value as first argument where applicable.
+     *  @tparam Functions Types of the callable entities, in order of preference.
+     */
+    template<bool PassThis, detail::any_invocable... Functions>
+    struct overload_wrapper
+    {
+        std::tuple<Functions...> functions;
+        const char* name{};
+    };
+
+    /** Creates an overload set of callables, e.g. module.add("f", qjs::overload(f1, f2)).
+     *  Overloaded C++ functions must be disambiguated with a cast first.
+     */
+    template<detail::any_invocable... Functions>
+    overload_wrapper<false, std::decay_t<Functions>...> overload(Functions&&... functions)
+    {
+        return { { std::forward<Functions>(functions)... } };
+    }
+
+    /** A wrapper type for a set of overloaded constructors of type T.
+     *  @tparam Signatures Constructor signatures written as function types, e.g. T(int, const std::string&).
+     */
+    template<typename T, typename... Signatures>
+        requires (detail::is_constructor_signature<Signatures, T>::value && ...)
+    struct ctor_overload_wrapper
+    {
+        const char* name{};
+    };
+
     template<typename T>
     struct rest : std::vector<T>
     {
@@ -112,6 +167,21 @@ namespace qjs
         using std::vector<T>::operator=;
     };
 
+    /** A wrapper type exposing a range to JS as an iterator instead of copying it into an array.
+     *  Elements are pulled from the range only as the iterator advances, so lazy views work too.
+     *  Example:
+     *  qjs::iterable<std::vector<int>> f() { return { get_ints() }; }
+     *  auto g() { return qjs::iterable { std::views::iota(0) | std::views::take(n) }; }
+     */
+    template<std::ranges::input_range Range>
+    struct iterable
+    {
+        Range range;
+    };
+
+    template<typename Range>
+    iterable(Range) -> iterable<Range>;
+
     /** Concept satisfied by any type that has a proper associated implementation of js_traits. */
     template<typename T>
     concept has_js_traits = requires(JSContext* ctx, JSValueConst val) {
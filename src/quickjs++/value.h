@@ -2,6 +2,7 @@
 #include "js_traits.h"
 #include "property_traits.h"
 #include <cassert>
+#include <iosfwd>
 
 namespace qjs
 {
@@ -240,6 +241,13 @@ namespace qjs
             return detail::unwrap_free<std::string>(ctx, JS_JSONStringify(ctx, v, replacer.v, space.v));
         }
 
+        /** Same as to_json() but hands the text to `sink` in chunks as it is produced. @see write_json */
+        void to_json(const std::function<void(std::string_view)>& sink,
+                     const value& replacer = value(JS_UNDEFINED), const value& space = value(JS_UNDEFINED)) const;
+
+        /** Same as to_json() but writes the text to a stream as it is produced. @see write_json */
+        void to_json(std::ostream& out, const value& replacer = value(JS_UNDEFINED), const value& space = value(JS_UNDEFINED)) const;
+
         /** Same as context::eval() but with this value as 'this'. */
         value eval_this(std::string_view buffer, const char* filename = "<evalThis>", int flags = 0)
         {
@@ -296,7 +304,7 @@ namespace qjs
             {
                 // async functions will return a promise which we want to handle
                 value fresult = as<std::function<value(Args...)>>()(std::forward<Args>(args)...);
-                if ((*this)["constructor"]["name"].as<std::string_view>() == "AsyncFunction")
+                if (JS_PromiseState(ctx, fresult.v) != JS_PROMISE_NOT_A_PROMISE)
                 {
                     fresult.invoke_then<R>(std::forward<F>(callback));
                 }